@@ -2,9 +2,22 @@
 #define NETWORK_MONITOR_TRANSPORT_NETWORK_H
 
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
+#include <utility>
 
 #include <nlohmann/json.hpp>
 
@@ -84,6 +97,17 @@ struct Line {
     bool operator==(const Line& other) const;
 };
 
+/*! \brief Travel time between two adjacent stations
+ *
+ *  The travel time is the same in both directions, and for all routes
+ *  connecting the two stations directly.
+ */
+struct TravelTime {
+    Id startStationId {};
+    Id endStationId {};
+    unsigned int travelTime {0};
+};
+
 /*! \brief Passenger event
  */
 struct PassengerEvent {
@@ -94,8 +118,66 @@ struct PassengerEvent {
 
     Id stationId {};
     Type type {Type::In};
+
+    // Events without a timestamp are recorded at the time they are received.
+    std::chrono::system_clock::time_point timestamp {};
+};
+
+/*! \brief Passengers entering and exiting a station over a time window
+ */
+struct PassengerFlow {
+    unsigned long long int in {0};
+    unsigned long long int out {0};
+};
+
+/*! \brief Number of passengers currently recorded at a station
+ */
+struct StationPassengerCount {
+    Id stationId {};
+    long long int passengerCount {0};
+};
+
+/*! \brief Station reachable from another one, and the fastest travel time to
+ *         it
+ */
+struct ReachableStation {
+    Id stationId {};
+    unsigned int travelTime {0};
 };
 
+/*! \brief Journey between two stations
+ *
+ *  A journey is a sequence of steps, each one between two adjacent stations
+ *  on a single route. Consecutive steps on different routes mean that the
+ *  passenger changes route at the station in between.
+ */
+struct TravelRoute {
+    /*! \brief Journey step between two adjacent stations
+     */
+    struct Step {
+        Id startStationId {};
+        Id endStationId {};
+        Id lineId {};
+        Id routeId {};
+        unsigned int travelTime {0};
+    };
+
+    Id startStationId {};
+    Id endStationId {};
+    unsigned int totalTravelTime {0};
+    std::vector<Step> steps {};
+};
+
+/*! \brief Cost of a journey step when crowding is taken into account
+ *
+ *  Takes the travel time of the step and the crowding level of the station the
+ *  step arrives at, and returns the cost that crowding-aware searches minimize.
+ */
+using CrowdingCost = std::function<unsigned int(
+    unsigned int travelTime,
+    size_t crowdingLevel
+)>;
+
 /*! \brief Underground network representation
  */
 class TransportNetwork {
@@ -109,6 +191,10 @@ public:
     ~TransportNetwork();
 
     /*! \brief Copy constructor
+     *
+     *  The copy shares the layout of the copied network (stations, lines,
+     *  routes, and edges, with their strings) until either network adds
+     *  stations or lines.
      */
     TransportNetwork(
         const TransportNetwork& copied
@@ -159,15 +245,107 @@ public:
         const Line& line
     );
 
+    /*! \brief Remove a line and all its routes from the network.
+     *
+     *  \returns false if the line is not in the network.
+     *
+     *  Only the edges and indices of the line's routes are updated; a frozen
+     *  graph stays frozen. The space of the line is reclaimed by Compact.
+     *  Travel times are kept, so that they apply again if the line is added
+     *  back.
+     */
+    bool RemoveLine(
+        const Id& line
+    );
+
+    /*! \brief Remove a route from the network.
+     *
+     *  \returns false if the route is not in the network.
+     *
+     *  Same as RemoveLine, for a single route. The line of the route stays in
+     *  the network, even if it has no routes left.
+     */
+    bool RemoveRoute(
+        const Id& route
+    );
+
+    /*! \brief Take a station out of service.
+     *
+     *  Every route serving the station skips it from now on: trains run from
+     *  the stop before the station to the stop after it, in the same time as
+     *  through the station, unless the two stops already have a travel time.
+     *  Routes left with fewer than 2 stops are removed.
+     *
+     *  The station itself stays in the network with its passenger counts. It
+     *  is served again once a line serving it is added, for example by
+     *  ApplyLayoutDiff.
+     *
+     *  \returns false if the station is not in the network.
+     */
+    bool SuspendStation(
+        const Id& station
+    );
+
+    /*! \brief Reclaim the space left by removed stations, lines, routes, and
+     *         stops.
+     *
+     *  Removals leave tombstones in the internal storage of the network, so
+     *  that they only cost as much as the removed items. Compact rebuilds the
+     *  storage without them, in time linear in the size of the network: call
+     *  it periodically, when queries can afford to wait. The IDs and names of
+     *  the remaining items are copied to new string storage, so the strings of
+     *  removed and renamed items are freed once no copy of the network uses
+     *  them. Passenger counts and history are kept; the travel time matrix and
+     *  contraction hierarchy are dropped.
+     */
+    void Compact();
+
+    /*! \brief Compact the station graph for read-only queries.
+     *
+     *  Moves the edges of every station into one contiguous compressed sparse
+     *  row (CSR) array, which all queries use afterwards. Call this once the
+     *  layout is loaded; FromJson does it automatically.
+     *
+     *  Stations and lines can still be added to a frozen network. Adding a line
+     *  expands the graph back to its per-station form until the next Freeze.
+     */
+    void Freeze();
+
+    /*! \brief Whether the station graph is currently in its compact form.
+     */
+    bool IsFrozen() const;
+
     /*! \brief Record a passenger event at a station.
      *
      *  \returns false if the station is not in the network or if the passenger
      *           event is not reconized.
+     *
+     *  Passenger counters are atomic: this method can be called from several
+     *  threads at once, concurrently with GetPassengerCount, as long as no
+     *  thread is changing the layout of the network.
      */
     bool RecordPassengerEvent(
         const PassengerEvent& event
     );
 
+    /*! \brief Record a batch of passenger events.
+     *
+     *  Station IDs are resolved once per run of events at the same station, and
+     *  the events are summed per station so that each station counter is
+     *  written once per batch.
+     *
+     *  \returns The positions in `events` of the events that were not
+     *           recorded, because the station is not in the network or the
+     *           passenger event is not recognized. Empty if every event was
+     *           recorded.
+     *
+     *  Like RecordPassengerEvent, this method can be called from several
+     *  threads at once.
+     */
+    std::vector<size_t> RecordPassengerEvents(
+        const std::vector<PassengerEvent>& events
+    );
+
     /*! \brief Get the number of passengers currently recorded at a station.
      *
      *  The returned number can be negative: This happens if we start recording
@@ -180,6 +358,132 @@ public:
         const Id& station
     ) const;
 
+    /*! \brief Keep a time-bucketed history of passenger events per station.
+     *
+     *  \param bucketWidth Time span summed into a single bucket.
+     *  \param nBuckets    Number of buckets kept per station. The history
+     *                     covers the last nBuckets * bucketWidth of events and
+     *                     its memory does not grow beyond that. 0 disables the
+     *                     history.
+     *
+     *  Any history recorded so far is discarded.
+     */
+    void SetPassengerFlowHistory(
+        const std::chrono::seconds bucketWidth,
+        const size_t nBuckets
+    );
+
+    /*! \brief Get the passengers entering and exiting a station over a time
+     *         window.
+     *
+     *  \param window Length of the window, ending at `now`. Windows are
+     *                aligned to bucket boundaries, and are truncated to the
+     *                length of the history.
+     *
+     *  \returns Zero counts if the history is disabled.
+     *
+     *  \throws std::runtime_error if the station is not in the network.
+     */
+    PassengerFlow GetPassengerFlow(
+        const Id& station,
+        const std::chrono::seconds window,
+        const std::chrono::system_clock::time_point now
+    ) const;
+
+    /*! \brief Get the number of passengers currently recorded at the stations
+     *         served by a line.
+     *
+     *  Stations served by several routes of the line are counted once.
+     *
+     *  \throws std::runtime_error if the line is not in the network.
+     */
+    long long int GetLinePassengerCount(
+        const Id& line
+    ) const;
+
+    /*! \brief Get the number of passengers currently recorded at the stations
+     *         served by a route.
+     *
+     *  \throws std::runtime_error if the route is not in the network.
+     */
+    long long int GetRoutePassengerCount(
+        const Id& route
+    ) const;
+
+    /*! \brief Get the k stations with the most passengers currently recorded.
+     *
+     *  \returns Up to k stations, most crowded first. Stations with the same
+     *           count are in the order they were added.
+     */
+    std::vector<StationPassengerCount> GetMostCrowdedStations(
+        const size_t k
+    ) const;
+
+    /*! \brief Get the IDs of all stations, by dense station index.
+     *
+     *  The index of a station in this vector is its position in the buffer
+     *  filled by ExportPassengerCounts. Removed stations have an empty ID.
+     *  Indices stay the same until the next Compact or LoadSnapshot.
+     *
+     *  The views stay valid until the next Compact of this network, as long
+     *  as this network or any copy of it is alive. Copies taken before Compact
+     *  keep the old strings alive.
+     */
+    std::vector<std::string_view> GetStationIds() const;
+
+    /*! \brief Copy the passenger counts of all stations into a buffer, by
+     *         dense station index.
+     *
+     *  \param counts Buffer of at least `size` counts. Removed stations get a
+     *                count of 0.
+     *  \param size   Size of the buffer. Only the first `size` stations are
+     *                copied if there are more.
+     *
+     *  \returns The number of stations, which can be more than the number of
+     *           counts copied.
+     *
+     *  A single pass over the station counters, with no ID lookups.
+     */
+    size_t ExportPassengerCounts(
+        long long int* counts,
+        const size_t size
+    ) const;
+
+    /*! \brief Get the name of a station.
+     *
+     *  \returns An empty view if the station is not in the network.
+     *
+     *  The view points into the string storage of the network, and stays valid
+     *  until the next Compact of this network, as long as this network or any
+     *  copy of it is alive. Copies taken before Compact keep the old strings
+     *  alive.
+     */
+    std::string_view GetStationName(
+        const Id& station
+    ) const;
+
+    /*! \brief Get the name of a line.
+     *
+     *  \returns An empty view if the line is not in the network.
+     *
+     *  The view stays valid until the next Compact of this network, as long as
+     *  this network or any copy of it is alive.
+     */
+    std::string_view GetLineName(
+        const Id& line
+    ) const;
+
+    /*! \brief Get the direction of a route.
+     *
+     *  \returns An empty view if the route is not in the network.
+     *
+     *  The view stays valid until the next Compact of this network, as long as
+     *  this network or any copy of it is alive.
+     */
+    std::string_view GetRouteDirection(
+        const Id& route
+    ) const;
+
     /*! \brief Get list of routes serving a given station.
      *
      *  \returns An empty vector if there was an error getting the list of
@@ -209,6 +513,22 @@ public:
         const unsigned int travelTime
     );
 
+    /*! \brief Set a batch of travel times.
+     *
+     *  Same as calling SetTravelTime for each entry in order, so later entries
+     *  for the same two stations win, but the updates are grouped by station
+     *  pair and checked for adjacency once per pair. The routes and travel
+     *  time matrix rows affected by any of the updates are then recomputed
+     *  once for the whole batch.
+     *
+     *  \returns The positions in `travelTimes` of the entries that were not
+     *           set, because a station is not in the network or the two
+     *           stations are not adjacent. Empty if every entry was set.
+     */
+    std::vector<size_t> SetTravelTimes(
+        const std::vector<TravelTime>& travelTimes
+    );
+
     /*! \brief Get the travel time between 2 adjacent stations.
      *
      *  \returns 0 if the function could not find the travel time between the
@@ -244,10 +564,191 @@ public:
         const Id& stationB
     ) const;
 
+    /*! \brief Get the fastest journey between any 2 stations.
+     *
+     *  \param changeRoutePenalty Extra time charged every time the journey
+     *                            changes route at a station. The penalty steers
+     *                            the search towards fewer changes but is not
+     *                            included in the returned total travel time.
+     *
+     *  \returns A journey with no steps if station B cannot be reached from
+     *           station A, or if station A and B are the same station.
+     *
+     *  The two stations must already be in the network.
+     */
+    TravelRoute GetFastestPath(
+        const Id& stationA,
+        const Id& stationB,
+        const unsigned int changeRoutePenalty = 0
+    ) const;
+
+    /*! \brief Get up to k fastest journeys between any 2 stations, none of
+     *         which visits a station twice.
+     *
+     *  Runs Yen's algorithm over the station graph: each journey after the
+     *  first is the fastest one that leaves an earlier journey at one of its
+     *  stations. Changing route is free. Each step rides a route that serves
+     *  both its stations, the route of the previous step if possible.
+     *
+     *  The searches reuse per-thread state, so repeated queries only allocate
+     *  for the journeys they return.
+     *
+     *  \returns The journeys, fastest first. Fewer than k if there are not as
+     *           many, and none if station B cannot be reached from station A,
+     *           or if station A and B are the same station.
+     *
+     *  The two stations must already be in the network.
+     */
+    std::vector<TravelRoute> GetAlternativeRoutes(
+        const Id& stationA,
+        const Id& stationB,
+        const size_t k
+    ) const;
+
+    /*! \brief Set how crowding changes the cost of journey steps.
+     *
+     *  \param thresholds Passenger counts at which a station moves up one
+     *                    crowding level. The crowding level of a station is
+     *                    the number of thresholds its passenger count reached:
+     *                    0 below all of them.
+     *  \param cost       Cost of a step given its travel time and the crowding
+     *                    level of the station it arrives at. It can be called
+     *                    from several threads at once. An empty function
+     *                    makes the cost of a step its travel time.
+     *
+     *  The cost of each step is cached, and only evaluated again once the
+     *  station it arrives at changes crowding level or the travel time of the
+     *  step changes. Recording passenger events does no extra work.
+     */
+    void SetCrowdingCost(
+        std::vector<long long int> thresholds,
+        CrowdingCost cost
+    );
+
+    /*! \brief Get the crowding-aware cost of travelling between 2 adjacent
+     *         stations, from station A to station B.
+     *
+     *  \returns 0 if the two stations are not adjacent, or if station A and B
+     *           are the same station.
+     *
+     *  The two stations must already be in the network.
+     */
+    unsigned int GetCrowdedTravelTime(
+        const Id& stationA,
+        const Id& stationB
+    ) const;
+
+    /*! \brief Get the journey between any 2 stations with the lowest
+     *         crowding-aware cost.
+     *
+     *  Same as GetFastestPath, but each step costs what the function set with
+     *  SetCrowdingCost returns for the current passenger counts. The steps of
+     *  the returned journey and its total travel time are still plain travel
+     *  times.
+     */
+    TravelRoute GetLeastCrowdedPath(
+        const Id& stationA,
+        const Id& stationB,
+        const unsigned int changeRoutePenalty = 0
+    ) const;
+
+    /*! \brief Get the fastest travel time between any 2 stations, over any
+     *         combination of routes.
+     *
+     *  Uses the travel time matrix if it was built, and searches the network
+     *  otherwise.
+     *
+     *  \returns 0 if station B cannot be reached from station A, or if station
+     *           A and B are the same station.
+     *
+     *  The two stations must already be in the network.
+     */
+    unsigned int GetFastestTravelTime(
+        const Id& stationA,
+        const Id& stationB
+    ) const;
+
+    /*! \brief Get the stations that can be reached from a station within a
+     *         travel time.
+     *
+     *  Runs a search from the station over any combination of routes, which
+     *  stops as soon as the next station is further than `maxTravelTime`. The
+     *  search reuses per-thread state, so its cost only depends on the part
+     *  of the network it reaches.
+     *
+     *  \returns The reachable stations with their fastest travel time, fastest
+     *           first, without the station itself. Empty if the station is not
+     *           in the network.
+     */
+    std::vector<ReachableStation> GetReachableStations(
+        const Id& station,
+        const unsigned int maxTravelTime
+    ) const;
+
+    /*! \brief Precompute the fastest travel time between every pair of
+     *         stations.
+     *
+     *  \param nThreads Number of threads running the searches. 0 means one per
+     *                  hardware thread.
+     *
+     *  The matrix is kept up to date by SetTravelTime, which recomputes only
+     *  the rows that can be affected by the updated edge. Adding stations or
+     *  lines drops the matrix.
+     */
+    void BuildTravelTimeMatrix(
+        const unsigned int nThreads = 0
+    );
+
+    /*! \brief Whether a travel time matrix is currently available.
+     */
+    bool HasTravelTimeMatrix() const;
+
+    /*! \brief Preprocess the network into a contraction hierarchy.
+     *
+     *  Stations are contracted one at a time, adding shortcut edges that
+     *  preserve the fastest travel times between the remaining stations.
+     *  GetFastestTravelTime then answers queries with a bidirectional search
+     *  that only follows edges towards more important stations.
+     *
+     *  The hierarchy is dropped when stations, lines, or travel times change.
+     */
+    void BuildContractionHierarchy();
+
+    /*! \brief Whether a contraction hierarchy is currently available.
+     */
+    bool HasContractionHierarchy() const;
+
+    /*! \brief Serialize the contraction hierarchy to a JSON object.
+     *
+     *  \returns An empty JSON object if there is no contraction hierarchy.
+     *
+     *  The JSON object is meant to be stored alongside the network layout and
+     *  loaded back with LoadContractionHierarchy.
+     */
+    nlohmann::json GetContractionHierarchyJson() const;
+
+    /*! \brief Load a contraction hierarchy saved with
+     *         GetContractionHierarchyJson.
+     *
+     *  \returns false if the hierarchy was built for a network with different
+     *           stations, or if it is inconsistent.
+     *
+     *  \throws nlohmann::json::exception If there was a problem parsing the
+     *                                    JSON object.
+     */
+    bool LoadContractionHierarchy(
+        const nlohmann::json& src
+    );
 
     /*! \brief Populate the network from a JSON object.
      *
-     *  \param src Ownership of the source JSON object is moved to this method.
+     *  \param src      Ownership of the source JSON object is moved to this
+     *                  method.
+     *  \param nThreads Number of threads parsing the lines and resolving their
+     *                  stops. The lines are then added in file order, so the
+     *                  network and the errors are the same as with a single
+     *                  thread. 1, the default, does everything on the calling
+     *                  thread. 0 means one per hardware thread.
      *
      *  \returns false if stations and lines where parsed successfully, but not
      *           the travel times.
@@ -259,69 +760,587 @@ public:
      *                                    JSON object.
      */
     bool FromJson(
-        nlohmann::json&& src
+        nlohmann::json&& src,
+        const unsigned int nThreads = 1
+    );
+
+    /*! \brief Populate the network from a JSON stream.
+     *
+     *  Same as the overload taking a JSON object, but the layout is parsed as a
+     *  stream of SAX events and fed into the network as it is read: the JSON
+     *  document is never held in memory as a whole.
+     *
+     *  \returns false if stations and lines where parsed successfully, but not
+     *           the travel times.
+     *
+     *  \throws nlohmann::json::exception If there was a problem parsing the
+     *                                    JSON stream, or if there was an issue
+     *                                    adding new stations or lines to the
+     *                                    network.
+     */
+    bool FromJson(
+        std::istream& src
     );
 
+    /*! \brief Update the network to a new layout, in place.
+     *
+     *  Compares the network with `src`, a layout in the same format as for
+     *  FromJson, and applies only the differences: stations and lines that were
+     *  added or removed, renamed stations and lines, lines whose routes
+     *  changed, and changed travel times. Unchanged stations keep their
+     *  passenger counts and flow history, and derived data is only updated for
+     *  what changed. A line whose routes changed is removed and added again.
+     *
+     *  Like the other removals, removed stations, lines, and routes leave
+     *  tombstones that only Compact reclaims.
+     *
+     *  \returns false if the layout was applied, but not all of its travel
+     *           times, like FromJson. Travel times that are not in `src` are
+     *           cleared.
+     *
+     *  \throws nlohmann::json::exception If there was a problem parsing the
+     *                                    JSON object, or if the layout has
+     *                                    duplicate IDs or stops at unknown
+     *                                    stations. The network is left
+     *                                    unchanged in that case.
+     */
+    bool ApplyLayoutDiff(
+        const nlohmann::json& src
+    );
+
+    /*! \brief Save the network layout and travel times to a binary snapshot.
+     *
+     *  The snapshot is a versioned and checksummed sequence of flat arrays:
+     *  a string table, stations, lines, routes, the CSR edges, and the travel
+     *  times. Records refer to each other by index or by offset only, so the
+     *  file can be mapped at any address and read in place by LoadSnapshot.
+     *
+     *  Passenger counts and derived tables (passenger flow history, travel
+     *  time matrix, contraction hierarchy) are not saved.
+     *
+     *  \returns false if the file could not be written.
+     */
+    bool SaveSnapshot(
+        const std::filesystem::path& destination
+    ) const;
+
+    /*! \brief Replace the network with a binary snapshot saved with
+     *         SaveSnapshot.
+     *
+     *  The file is memory-mapped and its arrays are copied straight into the
+     *  network, without going through AddStation and AddLine. The loaded
+     *  network is frozen. Passenger counts start from zero; the passenger flow
+     *  history settings and the crowding cost are kept.
+     *
+     *  \returns false if the file could not be mapped, or if it is not a
+     *           valid snapshot: wrong magic number or byte order, unsupported
+     *           version, checksum mismatch, or truncated or inconsistent data.
+     *           The network is left unchanged in that case.
+     */
+    bool LoadSnapshot(
+        const std::filesystem::path& source
+    );
+
+    /*! \brief Take an immutable snapshot of the network for reader threads.
+     *
+     *  The snapshot shares the layout, the travel time matrix, and the
+     *  contraction hierarchy with this network, and only copies what changes
+     *  without a layout change: passenger counts and history, and travel
+     *  times. Later changes to this network do not affect the snapshot, as
+     *  the network copies any shared part before changing it.
+     *
+     *  Any number of threads can query the snapshot while this network keeps
+     *  changing. Taking the snapshot itself must not run concurrently with
+     *  changes to this network.
+     *
+     *  Not to be confused with SaveSnapshot, which writes the layout to a file.
+     */
+    std::shared_ptr<const TransportNetwork> TakeSnapshot() const;
 
 private:
-    
+    /*! \brief Dense index of a station, line, or route.
+     *
+     *  External string IDs are interned to a dense index once, when the
+     *  station or line is added. All internal storage is indexed by it.
+     */
+    using Index = std::uint32_t;
+
+    static constexpr Index kInvalidIndex {
+        std::numeric_limits<Index>::max()
+    };
 
     struct GraphEdge {
-        Id lineId;
-        Id routeId;
-        Id nextStationId;
-        
+        Index lineIndex {kInvalidIndex};
+        Index routeIndex {kInvalidIndex};
+        Index nextStationIndex {kInvalidIndex};
+
         bool operator==(const GraphEdge& other) const {
-            return lineId == other.lineId &&
-                   routeId == other.routeId &&
-                   nextStationId == other.nextStationId;
+            return lineIndex == other.lineIndex &&
+                   routeIndex == other.routeIndex &&
+                   nextStationIndex == other.nextStationIndex;
         }
+    };
 
+    // Station connected to another one by edges, in either direction. The
+    // parallel edges of several routes share one entry, which counts them so
+    // that removing a route keeps the others.
+    struct Neighbor {
+        Index station {kInvalidIndex};
+        Index nEdgesOut {0};
+        Index nEdgesIn {0};
     };
 
+    // Removed stations, lines, and routes stay in place as tombstones, so that
+    // the indices of the others do not change. Their IDs are no longer in the
+    // ID indices, and nothing refers to them.
     struct GraphNode {
-        Id stationId;
-        std::string name {};
-        long long int passengerCount {0};
+        std::string_view stationId {};
+        std::string_view name {};
         std::vector<GraphEdge> edges {};
 
+        // Routes serving this station, kept sorted by route ID.
+        std::vector<Index> routes {};
 
+        // Neighbors of this station, kept sorted by station index.
+        std::vector<Neighbor> neighbors {};
 
+        bool removed {false};
     };
 
-    std::unordered_map<Id, GraphNode> stations_;                //store stations by id
-    std::unordered_map<Id, Line> lines_;                        //store lines by id
-    std::unordered_map<Id, Route> routes_;                      //store routes by id
-    std::unordered_map<Id, long long int> passengerCount_;      //passenger counts per station
+    // The routes of a line are added together, so they have consecutive
+    // indices.
+    struct LineNode {
+        std::string_view id {};
+        std::string_view name {};
+        Index firstRoute {0};
+        Index routeCount {0};
+        bool removed {false};
+    };
 
-    std::unordered_map<std::string, unsigned int> travelTimes_;
+    // The stops of a route are routeStops[stopOffset] onwards. Journey
+    // searches also use the offset to number (route, stop) pairs.
+    struct RouteNode {
+        std::string_view id {};
+        std::string_view direction {};
+        Index lineIndex {kInvalidIndex};
+        Index stopOffset {0};
+        Index stopCount {0};
+        bool removed {false};
+    };
 
-    bool AreAdjacent(const Id& stationA, const Id& stationB) const {
+    // Append-only storage for the IDs, names and directions of the layout.
+    // Strings are never moved or freed, so views into the pool stay valid for
+    // as long as the pool lives. Copies of a network share its pool; the lock
+    // guards the arena when they add strings concurrently. Compact starts a
+    // new pool.
+    struct StringPool {
+        std::mutex mutex {};
+        std::pmr::monotonic_buffer_resource arena {};
+    };
 
-        for (const auto& edge : stations_.at(stationA).edges) {
-            if (edge.nextStationId == stationB) {
-                return true;
-            }
+    // Static part of the network: everything that only changes when stations
+    // or lines are added. Copies and snapshots of a network share it, and the
+    // network copies it before changing it if it is shared (MutableLayout).
+    struct Layout {
+        std::shared_ptr<StringPool> strings {};
+
+        std::unordered_map<std::string_view, Index> stationIndices {};  //station id -> index
+        std::unordered_map<std::string_view, Index> lineIndices {};     //line id -> index
+        std::unordered_map<std::string_view, Index> routeIndices {};    //route id -> index
+
+        std::vector<GraphNode> stations {};                         //stations by index
+        std::vector<LineNode> lines {};                             //lines by index
+        std::vector<RouteNode> routes {};                           //routes by index
+
+        // Stops of all routes, one after the other, by station index. Stops
+        // removed from a route leave dead slots after its last stop.
+        std::vector<Index> routeStops {};
+
+        // Position of each station in the stops of its route, as (station,
+        // position) pairs aligned with routeStops and sorted by station
+        // within each route.
+        std::vector<std::pair<Index, Index>> stopPositions {};
+
+        // CSR adjacency, only populated while the network is frozen. The
+        // edges of station i are edges[edgeOffsets[i]] to edges[edgeEnds[i]].
+        // Removed edges leave dead slots between edgeEnds[i] and
+        // edgeOffsets[i + 1].
+        bool frozen {false};
+        std::vector<std::uint32_t> edgeOffsets {};
+        std::vector<std::uint32_t> edgeEnds {};
+        std::vector<GraphEdge> edges {};
+
+        // Removed stations, lines, routes, stops, and edges, and replaced
+        // names, still taking up space.
+        size_t nTombstones {0};
+    };
+
+    std::shared_ptr<const Layout> layout_ {std::make_shared<Layout>()};
+
+    // Travel time from the first stop of the route to each stop, aligned with
+    // the route stops of the layout. Kept up to date by SetTravelTime.
+    std::vector<unsigned int> cumulativeTimes_ {};
+
+    // Undirected edge between two stations, packed as (lower index << 32) |
+    // higher index.
+    using EdgeKey = std::uint64_t;
+
+    struct EdgeKeyHash {
+        std::size_t operator()(const EdgeKey key) const {
+            // splitmix64 finalizer: both station indices affect all bits.
+            EdgeKey hash {key};
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+            return static_cast<std::size_t>(hash ^ (hash >> 31));
         }
+    };
 
-        for (const auto& edge : stations_.at(stationB).edges) {
-            if (edge.nextStationId == stationA) {
-                return true;
-            }
+    std::unordered_map<EdgeKey, unsigned int, EdgeKeyHash> travelTimes_;
+
+    // Atomic counter that can live in a std::vector: copying or moving it
+    // copies the current value.
+    struct PassengerCounter {
+        std::atomic<long long int> value {0};
+
+        PassengerCounter() = default;
+
+        PassengerCounter(const PassengerCounter& other)
+            : value {other.value.load(std::memory_order_relaxed)}
+        {
+        }
+
+        PassengerCounter& operator=(const PassengerCounter& other) {
+            value.store(
+                other.value.load(std::memory_order_relaxed),
+                std::memory_order_relaxed
+            );
+            return *this;
+        }
+    };
+
+    // Passenger counts by station index.
+    std::vector<PassengerCounter> passengerCounts_ {};
+
+    // Ring buffer of time buckets per station. Each bucket holds the running
+    // In/Out totals at the end of the bucket, so the flow over any window is
+    // the difference of two buckets. The buckets of station i are
+    // flowBuckets_[i * flowBucketCount_] onwards.
+    struct FlowBucket {
+        long long int bucket {0};
+        unsigned long long int in {0};
+        unsigned long long int out {0};
+    };
+
+    // Newest bucket of a station, and the lock that guards its buckets. The
+    // lock is not copied with the rest of the network.
+    struct FlowHistory {
+        static constexpr long long int kEmpty {
+            std::numeric_limits<long long int>::min()
+        };
+
+        mutable std::mutex mutex {};
+        long long int head {kEmpty};
+
+        FlowHistory() = default;
+
+        FlowHistory(const FlowHistory& other)
+            : head {other.head}
+        {
+        }
+
+        FlowHistory& operator=(const FlowHistory& other) {
+            head = other.head;
+            return *this;
         }
-        return false;
+    };
+
+    // Passenger counts at which stations move up one crowding level, sorted.
+    std::vector<long long int> crowdingThresholds_ {};
+    CrowdingCost crowdingCost_ {};
+
+    // Cached crowding-aware cost of riding into each stop from the previous
+    // one, aligned with the route stops of the layout. Packed as
+    // (crowding level + 1) << 32 | cost, so that 0 means not computed. An
+    // entry is valid as long as the stop station stays at that crowding level.
+    struct CrowdedCost {
+        std::atomic<std::uint64_t> value {0};
+
+        CrowdedCost() = default;
+
+        CrowdedCost(const CrowdedCost& other)
+            : value {other.value.load(std::memory_order_relaxed)}
+        {
+        }
+
+        CrowdedCost& operator=(const CrowdedCost& other) {
+            value.store(
+                other.value.load(std::memory_order_relaxed),
+                std::memory_order_relaxed
+            );
+            return *this;
+        }
+    };
+
+    // Filled in by const queries.
+    mutable std::vector<CrowdedCost> crowdedCosts_ {};
+
+    std::chrono::seconds flowBucketWidth_ {0};
+    size_t flowBucketCount_ {0};
+    std::vector<FlowHistory> flowHistories_ {};
+    std::vector<FlowBucket> flowBuckets_ {};
+
+    static constexpr unsigned int kUnreachable {
+        std::numeric_limits<unsigned int>::max()
+    };
+
+    // All-pairs travel times, row-major by station index. Null unless
+    // BuildTravelTimeMatrix was called since the last layout change. Shared
+    // with copies and snapshots, and copied before an update if shared.
+    std::shared_ptr<const std::vector<unsigned int>> travelTimeMatrix_ {};
+    unsigned int travelTimeMatrixThreads_ {0};
+
+    // Contraction hierarchy, as two CSR graphs: the edges going up the
+    // hierarchy from each station, and the edges coming down the hierarchy
+    // into each station, reversed. Null unless BuildContractionHierarchy was
+    // called since the last change to the layout or travel times. It is
+    // never changed once built, so copies and snapshots share it.
+    struct HierarchyEdge {
+        Index station {kInvalidIndex};
+        unsigned int travelTime {0};
+    };
+    struct Hierarchy {
+        std::vector<std::uint32_t> upOffsets {};
+        std::vector<HierarchyEdge> upEdges {};
+        std::vector<std::uint32_t> downOffsets {};
+        std::vector<HierarchyEdge> downEdges {};
+    };
+    std::shared_ptr<const Hierarchy> hierarchy_ {};
+
+    struct EdgeRange {
+        const GraphEdge* first {nullptr};
+        const GraphEdge* last {nullptr};
+
+        const GraphEdge* begin() const { return first; }
+        const GraphEdge* end() const { return last; }
+    };
+
+    EdgeRange GetEdges(const Index station) const {
+        if (layout_->frozen) {
+            return {
+                layout_->edges.data() + layout_->edgeOffsets[station],
+                layout_->edges.data() + layout_->edgeEnds[station]
+            };
+        }
+        const auto& edges {layout_->stations[station].edges};
+        return {edges.data(), edges.data() + edges.size()};
+    }
+
+    Layout& MutableLayout();
+
+    void Thaw();
+
+    std::string_view Intern(const std::string_view value);
+
+    static std::string_view Intern(
+        StringPool& strings,
+        const std::string_view value
+    );
+
+    bool ResolveRouteStops(
+        const Line& line,
+        std::vector<Index>& routeStops
+    ) const;
+
+    bool AddResolvedLine(
+        const Line& line,
+        const std::vector<Index>& routeStops
+    );
+
+    void AddLinesJson(
+        const nlohmann::json& linesJson,
+        const size_t nWorkers
+    );
+
+    void AddServingRoute(const Index station, const Index route);
+
+    void RemoveServingRoute(const Index station, const Index route);
+
+    void LinkStations(const Index from, const Index to);
+
+    void UnlinkStations(const Index from, const Index to);
+
+    GraphEdge* FindRouteEdge(const Index station, const Index route);
+
+    void RemoveRouteEdge(const Index station, const Index route);
+
+    void RemoveRouteAt(const Index route);
+
+    void RemoveStop(const Index route, const Index station);
+
+    void RemoveLineAt(const Index line);
+
+    void RemoveStationAt(const Index station);
+
+    bool IsSameLine(
+        const LineNode& lineNode,
+        const Line& line
+    ) const;
+
+    void IndexRouteStops(const RouteNode& routeNode);
+
+    Index GetStopPosition(
+        const RouteNode& routeNode,
+        const Index station
+    ) const;
+
+    unsigned int GetEdgeTravelTime(
+        const Index stationA,
+        const Index stationB
+    ) const;
+
+    void SetEdgeTravelTime(
+        const Index stationA,
+        const Index stationB,
+        const unsigned int travelTime
+    );
+
+    long long int SumPassengerCounts(
+        std::vector<Index>& stations
+    ) const;
+
+    void RecordPassengerFlow(
+        const Index station,
+        const PassengerEvent& event
+    );
+
+    size_t GetCrowdingLevel(const Index station) const;
+
+    unsigned int GetCrowdedCost(
+        const Index stop,
+        const unsigned int travelTime
+    ) const;
+
+    void ClearCrowdedCosts(const RouteNode& routeNode);
+
+    TravelRoute SearchFastestPath(
+        const Id& stationA,
+        const Id& stationB,
+        const unsigned int changeRoutePenalty,
+        const bool crowded
+    ) const;
+
+    void ComputeTravelTimes(
+        const Index source,
+        unsigned int* travelTimes
+    ) const;
+
+    struct PathSearch;
+
+    unsigned int SearchPath(
+        const Index source,
+        const Index target,
+        PathSearch& search
+    ) const;
+
+    void ComputeTravelTimeMatrixRows(
+        const std::vector<Index>& sources,
+        unsigned int* matrix,
+        const unsigned int nThreads
+    ) const;
+
+    // Travel time change on the edge between two stations.
+    struct TravelTimeChange {
+        Index stationA {kInvalidIndex};
+        Index stationB {kInvalidIndex};
+        unsigned int oldTravelTime {0};
+        unsigned int newTravelTime {0};
+    };
+
+    void UpdateTravelTimeMatrix(
+        const std::vector<TravelTimeChange>& changes
+    );
+
+    unsigned int QueryContractionHierarchy(
+        const Index source,
+        const Index target
+    ) const;
+
+    void ClearContractionHierarchy();
+
+    void UpdateRouteTravelTimes(
+        const Index stationA,
+        const Index stationB,
+        const unsigned int oldTravelTime,
+        const unsigned int newTravelTime
+    );
+
+    void ComputeCumulativeTimes(const RouteNode& routeNode);
+
+    Index GetStationIndex(const Id& station) const {
+        auto it {layout_->stationIndices.find(station)};
+        return it != layout_->stationIndices.end() ? it->second : kInvalidIndex;
+    }
+
+    static std::vector<Neighbor>::const_iterator FindNeighbor(
+        const std::vector<Neighbor>& neighbors,
+        const Index station
+    ) {
+        return std::lower_bound(
+            neighbors.begin(), neighbors.end(), station,
+            [](const Neighbor& neighbor, const Index other) {
+                return neighbor.station < other;
+            }
+        );
+    }
+
+    bool AreAdjacent(const Index stationA, const Index stationB) const {
+        const auto& neighbors {layout_->stations[stationA].neighbors};
+        auto it {FindNeighbor(neighbors, stationB)};
+        return it != neighbors.end() && it->station == stationB;
     }
 
-    std::string MakeEdgeKey(const Id& stationA, const Id& stationB) const {
+    static EdgeKey MakeEdgeKey(const Index stationA, const Index stationB) {
         if (stationA < stationB) {
-            return stationA + "_" + stationB;
+            return (static_cast<EdgeKey>(stationA) << 32) | stationB;
         }
 
-        return stationB + "_" + stationA;
+        return (static_cast<EdgeKey>(stationB) << 32) | stationA;
     }
 
 };
 
+/*! \brief Immutable snapshot of a TransportNetwork.
+ */
+using TransportNetworkSnapshot = std::shared_ptr<const TransportNetwork>;
+
+/*! \brief Latest snapshot of a network, handed over from a writer thread to
+ *         reader threads.
+ *
+ *  The writer publishes snapshots taken with TransportNetwork::TakeSnapshot.
+ *  Readers get the latest one and query it for as long as they need to, while
+ *  the writer keeps updating its network. Publishing and getting a snapshot
+ *  only swap a reference-counted pointer atomically: readers never wait for
+ *  the writer to apply its updates.
+ */
+class SnapshotPublisher {
+public:
+    /*! \brief Make a snapshot the latest one.
+     */
+    void Publish(
+        TransportNetworkSnapshot snapshot
+    );
+
+    /*! \brief Get the latest snapshot.
+     *
+     *  \returns A null snapshot if none was published yet.
+     */
+    TransportNetworkSnapshot GetLatest() const;
+
+private:
+    // Only accessed through std::atomic_load and std::atomic_store.
+    TransportNetworkSnapshot latest_ {};
+};
+
 } // namespace NetworkMonitor
 
 #endif // NETWORK_MONITOR_TRANSPORT_NETWORK_H
\ No newline at end of file
@@ -1,182 +1,2928 @@
 #include <network-monitor/transport-network.h>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <nlohmann/json.hpp>
 
-namespace NetworkMonitor {
+namespace NetworkMonitor {
+
+namespace {
+
+/*! \brief Weighted edge used while building the contraction hierarchy.
+ */
+struct Arc {
+    std::uint32_t station;
+    unsigned int travelTime;
+};
+
+using Adjacency = std::vector<std::vector<Arc>>;
+
+void AddArc(
+    std::vector<Arc>& arcs,
+    const std::uint32_t station,
+    const unsigned int travelTime
+) {
+    for (auto& arc : arcs) {
+        if (arc.station == station) {
+            arc.travelTime = std::min(arc.travelTime, travelTime);
+            return;
+        }
+    }
+    arcs.push_back({station, travelTime});
+}
+
+/*! \brief Contracts the stations of a weighted directed graph one at a time.
+ *
+ *  Contracting a station removes it from the remaining graph and adds a
+ *  shortcut u -> x for every path u -> v -> x that has no equally fast
+ *  alternative (witness) avoiding v.
+ */
+class HierarchyBuilder {
+public:
+    HierarchyBuilder(
+        Adjacency&& outArcs,
+        Adjacency&& inArcs
+    ) : outArcs_ {std::move(outArcs)},
+        inArcs_ {std::move(inArcs)},
+        contracted_(outArcs_.size(), false),
+        contractedNeighbors_(outArcs_.size(), 0),
+        rank_(outArcs_.size(), 0),
+        witnessTimes_(outArcs_.size(), kUnreached)
+    {
+    }
+
+    /*! \brief Contract every station, least important first.
+     */
+    void Run()
+    {
+        using QueueItem = std::pair<int, std::uint32_t>;
+        std::priority_queue<
+            QueueItem,
+            std::vector<QueueItem>,
+            std::greater<QueueItem>
+        > queue {};
+        for (std::uint32_t station = 0; station < outArcs_.size(); ++station) {
+            queue.emplace(GetPriority(station), station);
+        }
+
+        std::uint32_t nextRank {0};
+        while (!queue.empty()) {
+            const std::uint32_t station {queue.top().second};
+            queue.pop();
+
+            // Priorities go stale as neighbors are contracted: re-evaluate
+            // lazily and postpone the station if it is no longer the minimum.
+            const int priority {GetPriority(station)};
+            if (!queue.empty() && priority > queue.top().first) {
+                queue.emplace(priority, station);
+                continue;
+            }
+
+            Contract(station, true);
+            contracted_[station] = true;
+            rank_[station] = nextRank++;
+            for (const auto& arc : outArcs_[station]) {
+                ++contractedNeighbors_[arc.station];
+            }
+            for (const auto& arc : inArcs_[station]) {
+                ++contractedNeighbors_[arc.station];
+            }
+        }
+    }
+
+    /*! \brief Original and shortcut edges leaving each station.
+     */
+    const Adjacency& GetOutArcs() const
+    {
+        return outArcs_;
+    }
+
+    /*! \brief Contraction order of each station.
+     */
+    const std::vector<std::uint32_t>& GetRanks() const
+    {
+        return rank_;
+    }
+
+private:
+    static constexpr unsigned int kUnreached {
+        std::numeric_limits<unsigned int>::max()
+    };
+
+    // Witness searches give up after this many settled stations, which may
+    // add a few unnecessary shortcuts but never a wrong one.
+    static constexpr size_t kWitnessSettleLimit {256};
+
+    Adjacency outArcs_;
+    Adjacency inArcs_;
+    std::vector<bool> contracted_;
+    std::vector<int> contractedNeighbors_;
+    std::vector<std::uint32_t> rank_;
+
+    std::vector<unsigned int> witnessTimes_;
+    std::vector<std::uint32_t> witnessTouched_ {};
+
+    int GetPriority(const std::uint32_t station)
+    {
+        int nArcs {0};
+        for (const auto& arc : outArcs_[station]) {
+            nArcs += contracted_[arc.station] ? 0 : 1;
+        }
+        for (const auto& arc : inArcs_[station]) {
+            nArcs += contracted_[arc.station] ? 0 : 1;
+        }
+        return Contract(station, false) - nArcs + contractedNeighbors_[station];
+    }
+
+    // Count (apply == false) or add (apply == true) the shortcuts needed to
+    // contract the station.
+    int Contract(
+        const std::uint32_t station,
+        const bool apply
+    )
+    {
+        int nShortcuts {0};
+        unsigned int maxOutTime {0};
+        for (const auto& out : outArcs_[station]) {
+            if (!contracted_[out.station]) {
+                maxOutTime = std::max(maxOutTime, out.travelTime);
+            }
+        }
+
+        // Shortcuts added while contracting are appended to the arc lists, so
+        // iterate over copies.
+        const std::vector<Arc> inArcs {inArcs_[station]};
+        const std::vector<Arc> outArcs {outArcs_[station]};
+        for (const auto& in : inArcs) {
+            if (contracted_[in.station]) continue;
+
+            FindWitnesses(in.station, station, in.travelTime + maxOutTime);
+            for (const auto& out : outArcs) {
+                if (contracted_[out.station] || out.station == in.station) {
+                    continue;
+                }
+                const unsigned int travelTime {in.travelTime + out.travelTime};
+                if (witnessTimes_[out.station] <= travelTime) continue;
+
+                ++nShortcuts;
+                if (apply) {
+                    AddArc(outArcs_[in.station], out.station, travelTime);
+                    AddArc(inArcs_[out.station], in.station, travelTime);
+                }
+            }
+            ResetWitnesses();
+        }
+        return nShortcuts;
+    }
+
+    void FindWitnesses(
+        const std::uint32_t source,
+        const std::uint32_t excluded,
+        const unsigned int maxTravelTime
+    )
+    {
+        using QueueItem = std::pair<unsigned int, std::uint32_t>;
+        std::priority_queue<
+            QueueItem,
+            std::vector<QueueItem>,
+            std::greater<QueueItem>
+        > queue {};
+
+        witnessTimes_[source] = 0;
+        witnessTouched_.push_back(source);
+        queue.emplace(0, source);
+        size_t nSettled {0};
+        while (!queue.empty() && nSettled < kWitnessSettleLimit) {
+            const QueueItem item {queue.top()};
+            queue.pop();
+            if (item.first > witnessTimes_[item.second]) continue;
+            if (item.first > maxTravelTime) break;
+            ++nSettled;
+
+            for (const auto& arc : outArcs_[item.second]) {
+                if (arc.station == excluded || contracted_[arc.station]) {
+                    continue;
+                }
+                const unsigned int travelTime {item.first + arc.travelTime};
+                if (travelTime < witnessTimes_[arc.station]) {
+                    if (witnessTimes_[arc.station] == kUnreached) {
+                        witnessTouched_.push_back(arc.station);
+                    }
+                    witnessTimes_[arc.station] = travelTime;
+                    queue.emplace(travelTime, arc.station);
+                }
+            }
+        }
+    }
+
+    void ResetWitnesses()
+    {
+        for (const auto station : witnessTouched_) {
+            witnessTimes_[station] = kUnreached;
+        }
+        witnessTouched_.clear();
+    }
+};
+
+/*! \brief Feeds a network layout read as SAX events into a TransportNetwork.
+ *
+ *  Stations, lines, and travel times are added as soon as each JSON object is
+ *  complete. Lines that precede the stations in the document, and travel times
+ *  that precede either, are held back until their dependencies are loaded.
+ */
+class LayoutSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit LayoutSaxHandler(
+        TransportNetwork& network
+    ) : network_ {network}
+    {
+    }
+
+    /*! \brief Load what was held back, once the whole stream has been read.
+     *
+     *  \returns false if some travel times could not be set.
+     */
+    bool Finish()
+    {
+        if (!stationsDone_) ThrowMissingKey("stations");
+        if (!linesDone_) ThrowMissingKey("lines");
+        if (!travelTimesDone_) ThrowMissingKey("travel_times");
+        return ok_;
+    }
+
+    bool null() override
+    {
+        return Value(nullptr, "null");
+    }
+
+    bool boolean(bool) override
+    {
+        return Value(nullptr, "boolean");
+    }
+
+    bool number_integer(number_integer_t val) override
+    {
+        return Number(static_cast<unsigned int>(val));
+    }
+
+    bool number_unsigned(number_unsigned_t val) override
+    {
+        return Number(static_cast<unsigned int>(val));
+    }
+
+    bool number_float(number_float_t val, const string_t&) override
+    {
+        return Number(static_cast<unsigned int>(val));
+    }
+
+    bool string(string_t& val) override
+    {
+        return Value(&val, "string");
+    }
+
+    bool binary(binary_t&) override
+    {
+        return Value(nullptr, "binary");
+    }
+
+    bool start_object(std::size_t) override
+    {
+        Context context {Context::Skip};
+        switch (Top()) {
+            case Context::None:
+                context = Context::Root;
+                break;
+            case Context::Stations:
+                context = Context::Station;
+                station_ = {};
+                break;
+            case Context::Lines:
+                context = Context::Line;
+                line_ = {};
+                break;
+            case Context::Routes:
+                context = Context::Route;
+                route_ = {};
+                break;
+            case Context::TravelTimes:
+                context = Context::TravelTime;
+                travelTime_ = {};
+                break;
+            default:
+                if (IsKnownKey()) ThrowWrongType("object");
+                break;
+        }
+        if (IsItem(context)) {
+            fields_ = 0;
+        }
+        contexts_.push_back(context);
+        return true;
+    }
+
+    bool key(string_t& val) override
+    {
+        key_ = std::move(val);
+        return true;
+    }
+
+    bool end_object() override
+    {
+        // The object is still on top of the stack while its fields are checked.
+        const Context context {Top()};
+        switch (context) {
+            case Context::Station:
+                RequireFields({"station_id", "name"});
+                if (!network_.AddStation(station_)) {
+                    throw nlohmann::json::other_error::create(
+                        501, "Couldnt add station " + station_.id, nullptr
+                    );
+                }
+                break;
+            case Context::Route:
+                RequireFields({
+                    "route_id", "direction", "line_id", "start_station_id",
+                    "end_station_id", "route_stops"
+                });
+                line_.routes.push_back(std::move(route_));
+                fields_ = lineFields_;
+                break;
+            case Context::Line:
+                RequireFields({"line_id", "name", "routes"});
+                if (stationsDone_) {
+                    AddLine(line_);
+                } else {
+                    pendingLines_.push_back(std::move(line_));
+                }
+                break;
+            case Context::TravelTime:
+                RequireFields({"start_station_id", "end_station_id", "travel_time"});
+                if (stationsDone_ && linesDone_) {
+                    SetTravelTime(travelTime_);
+                } else {
+                    pendingTravelTimes_.push_back(std::move(travelTime_));
+                }
+                break;
+            default:
+                break;
+        }
+        contexts_.pop_back();
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        Context context {Context::Skip};
+        if (Top() == Context::Root && key_ == "stations") {
+            context = Context::Stations;
+        } else if (Top() == Context::Root && key_ == "lines") {
+            context = Context::Lines;
+        } else if (Top() == Context::Root && key_ == "travel_times") {
+            context = Context::TravelTimes;
+        } else if (Top() == Context::Line && key_ == "routes") {
+            context = Context::Routes;
+            lineFields_ = fields_ | kRoutesField;
+        } else if (Top() == Context::Route && key_ == "route_stops") {
+            context = Context::RouteStops;
+            fields_ |= kRouteStopsField;
+        } else if (IsKnownKey()) {
+            ThrowWrongType("array");
+        }
+        contexts_.push_back(context);
+        return true;
+    }
+
+    bool end_array() override
+    {
+        const Context context {Top()};
+        contexts_.pop_back();
+        switch (context) {
+            case Context::Stations:
+                stationsDone_ = true;
+                for (const auto& line : pendingLines_) {
+                    AddLine(line);
+                }
+                pendingLines_.clear();
+                pendingLines_.shrink_to_fit();
+                if (linesDone_) FinishLines();
+                break;
+            case Context::Lines:
+                linesDone_ = true;
+                if (stationsDone_) FinishLines();
+                break;
+            case Context::Routes:
+                fields_ = lineFields_;
+                break;
+            case Context::TravelTimes:
+                travelTimesDone_ = true;
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool parse_error(
+        std::size_t,
+        const std::string&,
+        const nlohmann::json::exception& ex
+    ) override
+    {
+        if (auto parseError = dynamic_cast<const nlohmann::json::parse_error*>(&ex)) {
+            throw *parseError;
+        }
+        throw ex;
+    }
+
+private:
+    enum class Context {
+        None,
+        Root,
+        Stations,
+        Station,
+        Lines,
+        Line,
+        Routes,
+        Route,
+        RouteStops,
+        TravelTimes,
+        TravelTime,
+        Skip,
+    };
+
+    // Fields that are not strings, tracked in fields_ next to the string ones.
+    static constexpr unsigned int kTravelTimeField {1u << 8};
+    static constexpr unsigned int kRoutesField {1u << 9};
+    static constexpr unsigned int kRouteStopsField {1u << 10};
+
+    TransportNetwork& network_;
+    bool ok_ {true};
+    bool stationsDone_ {false};
+    bool linesDone_ {false};
+    bool travelTimesDone_ {false};
+
+    std::vector<Context> contexts_ {};
+    std::string key_ {};
+    unsigned int fields_ {0};
+    unsigned int lineFields_ {0};
+
+    Station station_ {};
+    Line line_ {};
+    Route route_ {};
+    TravelTime travelTime_ {};
+
+    std::vector<Line> pendingLines_ {};
+    std::vector<TravelTime> pendingTravelTimes_ {};
+
+    Context Top() const
+    {
+        return contexts_.empty() ? Context::None : contexts_.back();
+    }
+
+    static bool IsItem(const Context context)
+    {
+        return context == Context::Station || context == Context::Line ||
+               context == Context::Route || context == Context::TravelTime;
+    }
+
+    // The string fields of the current item, in the order of their bit in
+    // fields_.
+    const std::vector<std::pair<const char*, std::string*>> StringFields()
+    {
+        switch (Top()) {
+            case Context::Station:
+                return {
+                    {"station_id", &station_.id},
+                    {"name", &station_.name},
+                };
+            case Context::Line:
+                return {
+                    {"line_id", &line_.id},
+                    {"name", &line_.name},
+                };
+            case Context::Route:
+                return {
+                    {"route_id", &route_.id},
+                    {"direction", &route_.direction},
+                    {"line_id", &route_.lineId},
+                    {"start_station_id", &route_.startStationId},
+                    {"end_station_id", &route_.endStationId},
+                };
+            case Context::TravelTime:
+                return {
+                    {"start_station_id", &travelTime_.startStationId},
+                    {"end_station_id", &travelTime_.endStationId},
+                };
+            default:
+                return {};
+        }
+    }
+
+    // Whether the current value is one this handler reads, as opposed to a
+    // value it skips.
+    bool IsKnownKey()
+    {
+        if (Top() == Context::RouteStops) return true;
+        if (!IsItem(Top())) return false;
+        if ((Top() == Context::TravelTime && key_ == "travel_time") ||
+            (Top() == Context::Line && key_ == "routes") ||
+            (Top() == Context::Route && key_ == "route_stops")) {
+            return true;
+        }
+        for (const auto& field : StringFields()) {
+            if (key_ == field.first) return true;
+        }
+        return false;
+    }
+
+    bool Number(
+        const unsigned int val
+    )
+    {
+        if (Top() == Context::TravelTime && key_ == "travel_time") {
+            travelTime_.travelTime = val;
+            fields_ |= kTravelTimeField;
+            return true;
+        }
+        return Value(nullptr, "number");
+    }
+
+    bool Value(
+        string_t* val,
+        const char* typeName
+    )
+    {
+        if (!IsKnownKey()) return true;
+        if (val == nullptr) ThrowWrongType(typeName);
+
+        if (Top() == Context::RouteStops) {
+            route_.stops.push_back(std::move(*val));
+            return true;
+        }
+        const auto fields {StringFields()};
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (key_ == fields[i].first) {
+                *fields[i].second = std::move(*val);
+                fields_ |= 1u << i;
+                return true;
+            }
+        }
+        ThrowWrongType(typeName);
+    }
+
+    void RequireFields(
+        const std::vector<const char*>& keys
+    )
+    {
+        const auto fields {StringFields()};
+        for (const char* key : keys) {
+            unsigned int bit {0};
+            if (std::string(key) == "travel_time") {
+                bit = kTravelTimeField;
+            } else if (std::string(key) == "routes") {
+                bit = kRoutesField;
+            } else if (std::string(key) == "route_stops") {
+                bit = kRouteStopsField;
+            } else {
+                for (size_t i = 0; i < fields.size(); ++i) {
+                    if (std::string(key) == fields[i].first) bit = 1u << i;
+                }
+            }
+            if ((fields_ & bit) == 0) ThrowMissingKey(key);
+        }
+    }
+
+    void AddLine(
+        const Line& line
+    )
+    {
+        if (!network_.AddLine(line)) {
+            throw nlohmann::json::other_error::create(
+                501, "Couldnt add line " + line.id, nullptr
+            );
+        }
+    }
+
+    void SetTravelTime(
+        const TravelTime& item
+    )
+    {
+        ok_ &= network_.SetTravelTime(
+            item.startStationId,
+            item.endStationId,
+            item.travelTime
+        );
+    }
+
+    void FinishLines()
+    {
+        network_.Freeze();
+        ok_ &= network_.SetTravelTimes(pendingTravelTimes_).empty();
+        pendingTravelTimes_.clear();
+        pendingTravelTimes_.shrink_to_fit();
+    }
+
+    [[noreturn]] static void ThrowMissingKey(
+        const std::string& key
+    )
+    {
+        throw nlohmann::json::out_of_range::create(
+            403, "key '" + key + "' not found", nullptr
+        );
+    }
+
+    [[noreturn]] void ThrowWrongType(
+        const char* typeName
+    )
+    {
+        std::string expected {"string"};
+        if (Top() != Context::RouteStops) {
+            if (key_ == "travel_time") {
+                expected = "number";
+            } else if (key_ == "routes" || key_ == "route_stops") {
+                expected = "array";
+            }
+        }
+        throw nlohmann::json::type_error::create(
+            302,
+            "type must be " + expected + ", but is " + typeName,
+            nullptr
+        );
+    }
+};
+
+// Copy-on-write access to data shared between a network and its copies and
+// snapshots: the data is copied first if anyone else holds it. The data must
+// have been created non-const.
+template <typename T>
+T& MakeMutable(std::shared_ptr<const T>& shared)
+{
+    if (!shared) {
+        shared = std::make_shared<T>();
+    } else if (shared.use_count() > 1) {
+        shared = std::make_shared<T>(*shared);
+    } else {
+        // use_count is a relaxed load. The fence orders our writes after the
+        // reads of the last snapshot that released the data.
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return const_cast<T&>(*shared);
+}
+
+// Line with its routes, as stored in the "lines" array of a network layout.
+Line ParseLineJson(const nlohmann::json& lineJson)
+{
+    Line line {
+        lineJson.at("line_id").get<std::string>(),
+        lineJson.at("name").get<std::string>()
+    };
+    line.routes.reserve(lineJson.at("routes").size());
+
+    for (auto&& routeJson : lineJson.at("routes")) {
+        line.routes.emplace_back(Route {
+            routeJson.at("route_id").get<std::string>(),
+            routeJson.at("direction").get<std::string>(),
+            routeJson.at("line_id").get<std::string>(),
+            routeJson.at("start_station_id").get<std::string>(),
+            routeJson.at("end_station_id").get<std::string>(),
+            routeJson.at("route_stops").get<std::vector<std::string>>()
+        });
+    }
+    return line;
+}
+
+// Binary snapshot header. Integers are stored in the byte order of the machine
+// that wrote the snapshot; kSnapshotByteOrder reads differently on a machine
+// with the other byte order, which rejects the file.
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t byteOrder;
+    std::uint32_t version;
+    std::uint64_t payloadSize;
+    std::uint64_t checksum;
+};
+static_assert(sizeof(SnapshotHeader) == 32, "Unexpected snapshot header padding");
+
+constexpr char kSnapshotMagic[8] {'N', 'M', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr std::uint32_t kSnapshotByteOrder {0x01020304};
+constexpr std::uint32_t kSnapshotVersion {1};
+
+// 64-bit FNV-1a hash of the snapshot payload.
+std::uint64_t SnapshotChecksum(const char* data, const size_t size)
+{
+    std::uint64_t hash {0xcbf29ce484222325ULL};
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Appends plain values to the snapshot records. Strings go to a separate
+// table and are written to the records as (offset, length) pairs.
+class SnapshotWriter {
+public:
+    template <typename T>
+    void Write(const T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "");
+        const char* bytes {reinterpret_cast<const char*>(&value)};
+        records_.insert(records_.end(), bytes, bytes + sizeof(T));
+    }
+
+    void WriteString(const std::string_view value)
+    {
+        Write(static_cast<std::uint32_t>(strings_.size()));
+        Write(static_cast<std::uint32_t>(value.size()));
+        strings_.insert(strings_.end(), value.begin(), value.end());
+    }
+
+    // Payload: the string table size, the string table, then the records.
+    std::vector<char> GetPayload() const
+    {
+        std::vector<char> payload {};
+        payload.reserve(sizeof(std::uint64_t) + strings_.size() + records_.size());
+        const std::uint64_t stringsSize {strings_.size()};
+        const char* bytes {reinterpret_cast<const char*>(&stringsSize)};
+        payload.insert(payload.end(), bytes, bytes + sizeof(stringsSize));
+        payload.insert(payload.end(), strings_.begin(), strings_.end());
+        payload.insert(payload.end(), records_.begin(), records_.end());
+        return payload;
+    }
+
+private:
+    std::vector<char> strings_ {};
+    std::vector<char> records_ {};
+};
+
+// Reads values back from a snapshot payload, in place. Any out-of-bounds read
+// marks the reader as failed and returns zero values from then on.
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, const size_t size)
+        : data_ {data}, size_ {size}
+    {
+        const std::uint64_t stringsSize {Read<std::uint64_t>()};
+        if (stringsSize > size_ - pos_) {
+            ok_ = false;
+            return;
+        }
+        strings_ = data_ + pos_;
+        stringsSize_ = static_cast<size_t>(stringsSize);
+        pos_ += stringsSize_;
+    }
+
+    template <typename T>
+    T Read()
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "");
+        T value {};
+        if (!ok_ || size_ - pos_ < sizeof(T)) {
+            ok_ = false;
+            return value;
+        }
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    // The view points into the snapshot data.
+    std::string_view ReadString()
+    {
+        const std::uint32_t offset {Read<std::uint32_t>()};
+        const std::uint32_t length {Read<std::uint32_t>()};
+        if (!ok_ || offset > stringsSize_ || length > stringsSize_ - offset) {
+            ok_ = false;
+            return {};
+        }
+        return {strings_ + offset, length};
+    }
+
+    // Whether `count` records of `recordSize` bytes can still be read. Checked
+    // before reserving memory for them.
+    bool CanRead(const size_t count, const size_t recordSize)
+    {
+        if (!ok_ || (size_ - pos_) / recordSize < count) {
+            ok_ = false;
+        }
+        return ok_;
+    }
+
+    bool IsOk() const
+    {
+        return ok_;
+    }
+
+    bool IsAtEnd() const
+    {
+        return ok_ && pos_ == size_;
+    }
+
+private:
+    const char* data_ {nullptr};
+    size_t size_ {0};
+    size_t pos_ {0};
+    const char* strings_ {nullptr};
+    size_t stringsSize_ {0};
+    bool ok_ {true};
+};
+
+} // namespace
+
+TransportNetwork::TransportNetwork() = default;
+
+TransportNetwork::~TransportNetwork() = default;
+
+bool Station::operator==(const Station& other) const {
+    return id == other.id;
+}
+
+bool Line::operator==(const Line& other) const {
+    return id == other.id;
+}
+
+bool Route::operator==(const Route& other) const {
+    return id == other.id;
+}
+
+TransportNetwork::TransportNetwork(const TransportNetwork& copied) = default;
+TransportNetwork::TransportNetwork(TransportNetwork&& moved) = default;
+
+TransportNetwork& TransportNetwork::operator=(const TransportNetwork& copied) = default;
+TransportNetwork& TransportNetwork::operator=(TransportNetwork&& moved) = default;
+
+
+bool TransportNetwork::AddStation(const Station& station) {
+    if (layout_->stationIndices.count(station.id) > 0) return false;
+
+    Layout& layout {MutableLayout()};
+
+    GraphNode node;
+    node.stationId = Intern(station.id);
+    node.name = Intern(station.name);
+
+    const Index stationIndex {static_cast<Index>(layout.stations.size())};
+    layout.stationIndices.emplace(node.stationId, stationIndex);
+    layout.stations.push_back(std::move(node));
+    passengerCounts_.emplace_back();
+    if (flowBucketCount_ > 0) {
+        flowHistories_.emplace_back();
+        flowBuckets_.resize(flowBuckets_.size() + flowBucketCount_);
+    }
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+
+    // A new station has no edges, so the CSR layout only needs a new row.
+    if (layout.frozen) {
+        layout.edgeEnds.push_back(
+            static_cast<std::uint32_t>(layout.edges.size())
+        );
+        layout.edgeOffsets.push_back(
+            static_cast<std::uint32_t>(layout.edges.size())
+        );
+    }
+    return true;
+}
+
+bool TransportNetwork::AddLine(const Line& line) {
+    // Resolve every stop before touching the graph, so that a bad route leaves
+    // the network unchanged.
+    std::vector<Index> routeStops {};
+    if (!ResolveRouteStops(line, routeStops)) return false;
+
+    return AddResolvedLine(line, routeStops);
+}
+
+std::string_view TransportNetwork::Intern(const std::string_view value) {
+    Layout& layout {MutableLayout()};
+
+    // The pool is created with the first string.
+    if (!layout.strings) {
+        layout.strings = std::make_shared<StringPool>();
+    }
+    return Intern(*layout.strings, value);
+}
+
+std::string_view TransportNetwork::Intern(
+    StringPool& strings,
+    const std::string_view value
+) {
+    if (value.empty()) return {};
+
+    std::lock_guard<std::mutex> lock {strings.mutex};
+    auto data {static_cast<char*>(strings.arena.allocate(value.size(), 1))};
+    std::memcpy(data, value.data(), value.size());
+    return {data, value.size()};
+}
+
+bool TransportNetwork::ResolveRouteStops(
+    const Line& line,
+    std::vector<Index>& routeStops
+) const {
+    size_t nStops {0};
+    for (const Route& route : line.routes) {
+        nStops += route.stops.size();
+    }
+    routeStops.clear();
+    routeStops.reserve(nStops);
+
+    for (const Route& route : line.routes) {
+        for (const Id& stationId : route.stops) {
+            Index stationIndex {GetStationIndex(stationId)};
+            if (stationIndex == kInvalidIndex) return false;
+            routeStops.push_back(stationIndex);
+        }
+    }
+    return true;
+}
+
+bool TransportNetwork::AddResolvedLine(
+    const Line& line,
+    const std::vector<Index>& routeStops
+) {
+    if (layout_->lineIndices.count(line.id) > 0) return false;
+
+    for (size_t i = 0; i < line.routes.size(); ++i) {
+        const Route& route {line.routes[i]};
+        if (layout_->routeIndices.count(route.id) > 0) return false;
+        for (size_t j = 0; j < i; ++j) {
+            if (line.routes[j].id == route.id) return false;
+        }
+    }
+
+    if (layout_->frozen) {
+        Thaw();
+    }
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+
+    Layout& layout {MutableLayout()};
+    const Index lineIndex {static_cast<Index>(layout.lines.size())};
+    LineNode lineNode;
+    lineNode.id = Intern(line.id);
+    lineNode.name = Intern(line.name);
+    lineNode.firstRoute = static_cast<Index>(layout.routes.size());
+    lineNode.routeCount = static_cast<Index>(line.routes.size());
+
+    const Index* stops {routeStops.data()};
+    for (const Route& route : line.routes) {
+        const Index routeIndex {static_cast<Index>(layout.routes.size())};
+        const size_t nStops {route.stops.size()};
+
+        for (size_t j = 0; j + 1 < nStops; ++j) {
+            GraphEdge edge;
+            edge.lineIndex = lineIndex;
+            edge.routeIndex = routeIndex;
+            edge.nextStationIndex = stops[j + 1];
+
+            layout.stations[stops[j]].edges.push_back(edge);
+            LinkStations(stops[j], stops[j + 1]);
+        }
+
+        RouteNode routeNode;
+        routeNode.id = Intern(route.id);
+        routeNode.direction = Intern(route.direction);
+        routeNode.lineIndex = lineIndex;
+        routeNode.stopOffset = static_cast<Index>(layout.routeStops.size());
+        routeNode.stopCount = static_cast<Index>(nStops);
+        layout.routeStops.insert(layout.routeStops.end(), stops, stops + nStops);
+        stops += nStops;
+
+        // Travel times may already be known for edges shared with other lines.
+        IndexRouteStops(routeNode);
+
+        layout.routeIndices.emplace(routeNode.id, routeIndex);
+        layout.routes.push_back(routeNode);
+
+        for (Index j = 0; j < routeNode.stopCount; ++j) {
+            AddServingRoute(layout.routeStops[routeNode.stopOffset + j], routeIndex);
+        }
+    }
+
+    layout.lineIndices.emplace(lineNode.id, lineIndex);
+    layout.lines.push_back(lineNode);
+
+    return true;
+}
+
+void TransportNetwork::AddServingRoute(
+    const Index station,
+    const Index route
+) {
+    Layout& layout {MutableLayout()};
+    auto& routes {layout.stations[station].routes};
+    const std::string_view routeId {layout.routes[route].id};
+    auto it = std::lower_bound(
+        routes.begin(), routes.end(), routeId,
+        [&layout](const Index other, const std::string_view id) {
+            return layout.routes[other].id < id;
+        }
+    );
+    if (it == routes.end() || *it != route) {
+        routes.insert(it, route);
+    }
+}
+
+void TransportNetwork::RemoveServingRoute(
+    const Index station,
+    const Index route
+) {
+    Layout& layout {MutableLayout()};
+    auto& routes {layout.stations[station].routes};
+    const std::string_view routeId {layout.routes[route].id};
+    auto it = std::lower_bound(
+        routes.begin(), routes.end(), routeId,
+        [&layout](const Index other, const std::string_view id) {
+            return layout.routes[other].id < id;
+        }
+    );
+    if (it != routes.end() && *it == route) {
+        routes.erase(it);
+    }
+}
+
+TransportNetwork::GraphEdge* TransportNetwork::FindRouteEdge(
+    const Index station,
+    const Index route
+) {
+    Layout& layout {MutableLayout()};
+    GraphEdge* first {nullptr};
+    GraphEdge* last {nullptr};
+    if (layout.frozen) {
+        first = layout.edges.data() + layout.edgeOffsets[station];
+        last = layout.edges.data() + layout.edgeEnds[station];
+    } else {
+        first = layout.stations[station].edges.data();
+        last = first + layout.stations[station].edges.size();
+    }
+    GraphEdge* edge {std::find_if(first, last, [route](const GraphEdge& other) {
+        return other.routeIndex == route;
+    })};
+    return edge != last ? edge : nullptr;
+}
+
+void TransportNetwork::RemoveRouteEdge(
+    const Index station,
+    const Index route
+) {
+    // A route stops once at a station, so it has at most one edge there.
+    GraphEdge* edge {FindRouteEdge(station, route)};
+    if (edge == nullptr) return;
+    UnlinkStations(station, edge->nextStationIndex);
+
+    Layout& layout {MutableLayout()};
+    if (layout.frozen) {
+        // Close the gap within the CSR row of the station. The last slot of
+        // the row becomes dead.
+        GraphEdge* last {layout.edges.data() + layout.edgeEnds[station]};
+        std::copy(edge + 1, last, edge);
+        --layout.edgeEnds[station];
+        ++layout.nTombstones;
+    } else {
+        auto& edges {layout.stations[station].edges};
+        edges.erase(edges.begin() + (edge - edges.data()));
+    }
+}
+
+void TransportNetwork::LinkStations(
+    const Index from,
+    const Index to
+) {
+    auto link = [](std::vector<Neighbor>& neighbors, const Index station) {
+        auto it {neighbors.begin() + (FindNeighbor(neighbors, station) - neighbors.begin())};
+        if (it == neighbors.end() || it->station != station) {
+            it = neighbors.insert(it, Neighbor {station, 0, 0});
+        }
+        return it;
+    };
+    Layout& layout {MutableLayout()};
+    ++link(layout.stations[from].neighbors, to)->nEdgesOut;
+    ++link(layout.stations[to].neighbors, from)->nEdgesIn;
+}
+
+void TransportNetwork::UnlinkStations(
+    const Index from,
+    const Index to
+) {
+    auto unlink = [](
+        std::vector<Neighbor>& neighbors,
+        const Index station,
+        const bool out
+    ) {
+        auto it {neighbors.begin() + (FindNeighbor(neighbors, station) - neighbors.begin())};
+        if (it == neighbors.end() || it->station != station) return;
+        --(out ? it->nEdgesOut : it->nEdgesIn);
+        if (it->nEdgesOut == 0 && it->nEdgesIn == 0) {
+            neighbors.erase(it);
+        }
+    };
+    Layout& layout {MutableLayout()};
+    unlink(layout.stations[from].neighbors, to, true);
+    unlink(layout.stations[to].neighbors, from, false);
+}
+
+void TransportNetwork::RemoveRouteAt(const Index route) {
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+
+    // The stops, stop positions, and cumulative times of the route stay in
+    // the flat arrays until the next compaction.
+    const RouteNode routeNode {layout_->routes[route]};
+    for (Index j = 0; j < routeNode.stopCount; ++j) {
+        const Index station {layout_->routeStops[routeNode.stopOffset + j]};
+        RemoveRouteEdge(station, route);
+        RemoveServingRoute(station, route);
+    }
+
+    Layout& layout {MutableLayout()};
+    layout.routeIndices.erase(routeNode.id);
+    layout.routes[route].removed = true;
+    ++layout.nTombstones;
+}
+
+void TransportNetwork::RemoveStop(
+    const Index route,
+    const Index station
+) {
+    const RouteNode routeNode {layout_->routes[route]};
+    if (routeNode.stopCount <= 2) {
+        RemoveRouteAt(route);
+        return;
+    }
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+
+    Layout& layout {MutableLayout()};
+    const Index position {GetStopPosition(routeNode, station)};
+    const Index lastPosition {routeNode.stopCount - 1};
+    Index* stops {layout.routeStops.data() + routeNode.stopOffset};
+    if (position > 0 && position < lastPosition) {
+        // Trains now run from the previous stop straight to the next one.
+        const Index previous {stops[position - 1]};
+        const Index next {stops[position + 1]};
+        const EdgeKey key {MakeEdgeKey(previous, next)};
+        if (travelTimes_.count(key) == 0) {
+            travelTimes_[key] = GetEdgeTravelTime(previous, station) +
+                GetEdgeTravelTime(station, next);
+        }
+        UnlinkStations(previous, station);
+        LinkStations(previous, next);
+        FindRouteEdge(previous, route)->nextStationIndex = next;
+    } else if (position == lastPosition) {
+        RemoveRouteEdge(stops[position - 1], route);
+    }
+    RemoveRouteEdge(station, route);
+    RemoveServingRoute(station, route);
+
+    // Close the gap in the stops and stop positions of the route, which
+    // leaves a dead slot after its last stop.
+    std::copy(stops + position + 1, stops + routeNode.stopCount, stops + position);
+    auto* positions {layout.stopPositions.data() + routeNode.stopOffset};
+    auto positionsEnd = std::remove_if(
+        positions, positions + routeNode.stopCount,
+        [station](const std::pair<Index, Index>& stopPosition) {
+            return stopPosition.first == station;
+        }
+    );
+    for (auto* it {positions}; it != positionsEnd; ++it) {
+        if (it->second > position) --it->second;
+    }
+    --layout.routes[route].stopCount;
+    ++layout.nTombstones;
+    ComputeCumulativeTimes(layout.routes[route]);
+    ClearCrowdedCosts(layout.routes[route]);
+}
+
+bool TransportNetwork::RemoveLine(const Id& line) {
+    auto it {layout_->lineIndices.find(line)};
+    if (it == layout_->lineIndices.end()) return false;
+
+    RemoveLineAt(it->second);
+    return true;
+}
+
+bool TransportNetwork::RemoveRoute(const Id& route) {
+    auto it {layout_->routeIndices.find(route)};
+    if (it == layout_->routeIndices.end()) return false;
+
+    RemoveRouteAt(it->second);
+    return true;
+}
+
+bool TransportNetwork::SuspendStation(const Id& station) {
+    const Index stationIndex {GetStationIndex(station)};
+    if (stationIndex == kInvalidIndex) return false;
+
+    // The list shrinks as the routes stop serving the station.
+    const std::vector<Index> routes {layout_->stations[stationIndex].routes};
+    for (const Index route : routes) {
+        RemoveStop(route, stationIndex);
+    }
+    return true;
+}
+
+void TransportNetwork::RemoveLineAt(const Index line) {
+    const LineNode lineNode {layout_->lines[line]};
+    for (Index route = lineNode.firstRoute;
+         route < lineNode.firstRoute + lineNode.routeCount; ++route) {
+        if (!layout_->routes[route].removed) {
+            RemoveRouteAt(route);
+        }
+    }
+
+    Layout& layout {MutableLayout()};
+    layout.lineIndices.erase(lineNode.id);
+    layout.lines[line].removed = true;
+    ++layout.nTombstones;
+}
+
+void TransportNetwork::RemoveStationAt(const Index station) {
+    // The routes serving the station must have been removed first, so the
+    // station has no edges left and its CSR row, if frozen, is empty.
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+
+    Layout& layout {MutableLayout()};
+    GraphNode& node {layout.stations[station]};
+    layout.stationIndices.erase(node.stationId);
+    node.removed = true;
+    ++layout.nTombstones;
+}
+
+bool TransportNetwork::IsSameLine(
+    const LineNode& lineNode,
+    const Line& line
+) const {
+    size_t nRoutes {0};
+    for (Index route = lineNode.firstRoute;
+         route < lineNode.firstRoute + lineNode.routeCount; ++route) {
+        const RouteNode& routeNode {layout_->routes[route]};
+        if (routeNode.removed) continue;
+        if (nRoutes == line.routes.size()) return false;
+
+        const Route& other {line.routes[nRoutes++]};
+        if (routeNode.id != other.id || routeNode.direction != other.direction ||
+            routeNode.stopCount != other.stops.size()) {
+            return false;
+        }
+        for (Index j = 0; j < routeNode.stopCount; ++j) {
+            const Index station {layout_->routeStops[routeNode.stopOffset + j]};
+            if (layout_->stations[station].stationId != other.stops[j]) {
+                return false;
+            }
+        }
+    }
+    return nRoutes == line.routes.size();
+}
+
+void TransportNetwork::Compact() {
+    if (layout_->nTombstones == 0) return;
+
+    const Layout& old {*layout_};
+    const bool wasFrozen {old.frozen};
+    auto layout {std::make_shared<Layout>()};
+
+    // The remaining strings move to a new pool. The old one, with the strings
+    // of removed and renamed items, goes away with the last copy using it.
+    layout->strings = std::make_shared<StringPool>();
+    StringPool& strings {*layout->strings};
+
+    // Old index -> new index, kInvalidIndex for tombstones. Stations keep
+    // their relative order, so the stop positions of each route stay sorted.
+    std::vector<Index> stationMap(old.stations.size(), kInvalidIndex);
+    std::vector<Index> lineMap(old.lines.size(), kInvalidIndex);
+    std::vector<Index> routeMap(old.routes.size(), kInvalidIndex);
+
+    std::vector<PassengerCounter> passengerCounts {};
+    std::vector<FlowHistory> flowHistories {};
+    std::vector<FlowBucket> flowBuckets {};
+    for (Index station = 0; station < old.stations.size(); ++station) {
+        const GraphNode& node {old.stations[station]};
+        if (node.removed) continue;
+
+        stationMap[station] = static_cast<Index>(layout->stations.size());
+        GraphNode compacted {};
+        compacted.stationId = Intern(strings, node.stationId);
+        compacted.name = Intern(strings, node.name);
+        layout->stationIndices.emplace(compacted.stationId, stationMap[station]);
+        layout->stations.push_back(std::move(compacted));
+        passengerCounts.push_back(passengerCounts_[station]);
+        if (flowBucketCount_ > 0) {
+            flowHistories.push_back(flowHistories_[station]);
+            flowBuckets.insert(
+                flowBuckets.end(),
+                flowBuckets_.begin() + station * flowBucketCount_,
+                flowBuckets_.begin() + (station + 1) * flowBucketCount_
+            );
+        }
+    }
+
+    std::vector<unsigned int> cumulativeTimes {};
+    for (Index line = 0; line < old.lines.size(); ++line) {
+        if (old.lines[line].removed) continue;
+
+        lineMap[line] = static_cast<Index>(layout->lines.size());
+        LineNode lineNode {old.lines[line]};
+        lineNode.id = Intern(strings, lineNode.id);
+        lineNode.name = Intern(strings, lineNode.name);
+        lineNode.firstRoute = static_cast<Index>(layout->routes.size());
+        lineNode.routeCount = 0;
+        for (Index route = old.lines[line].firstRoute;
+             route < old.lines[line].firstRoute + old.lines[line].routeCount;
+             ++route) {
+            if (old.routes[route].removed) continue;
+
+            routeMap[route] = static_cast<Index>(layout->routes.size());
+            RouteNode routeNode {old.routes[route]};
+            routeNode.id = Intern(strings, routeNode.id);
+            routeNode.direction = Intern(strings, routeNode.direction);
+            routeNode.lineIndex = lineMap[line];
+            routeNode.stopOffset = static_cast<Index>(layout->routeStops.size());
+            for (Index j = 0; j < routeNode.stopCount; ++j) {
+                const Index stop {old.routes[route].stopOffset + j};
+                layout->routeStops.push_back(stationMap[old.routeStops[stop]]);
+                layout->stopPositions.emplace_back(
+                    stationMap[old.stopPositions[stop].first],
+                    old.stopPositions[stop].second
+                );
+                cumulativeTimes.push_back(cumulativeTimes_[stop]);
+            }
+            layout->routeIndices.emplace(routeNode.id, routeMap[route]);
+            layout->routes.push_back(routeNode);
+            ++lineNode.routeCount;
+        }
+        layout->lineIndices.emplace(lineNode.id, lineMap[line]);
+        layout->lines.push_back(lineNode);
+    }
+
+    // Serving routes are still sorted by route ID, as the IDs do not change,
+    // and neighbors by station index, as the stations keep their order.
+    for (Index station = 0; station < old.stations.size(); ++station) {
+        if (stationMap[station] == kInvalidIndex) continue;
+
+        GraphNode& node {layout->stations[stationMap[station]]};
+        for (const Index route : old.stations[station].routes) {
+            node.routes.push_back(routeMap[route]);
+        }
+        for (const auto& neighbor : old.stations[station].neighbors) {
+            node.neighbors.push_back({
+                stationMap[neighbor.station],
+                neighbor.nEdgesOut,
+                neighbor.nEdgesIn
+            });
+        }
+        for (const auto& edge : GetEdges(station)) {
+            GraphEdge compacted;
+            compacted.lineIndex = lineMap[edge.lineIndex];
+            compacted.routeIndex = routeMap[edge.routeIndex];
+            compacted.nextStationIndex = stationMap[edge.nextStationIndex];
+            node.edges.push_back(compacted);
+        }
+    }
+
+    decltype(travelTimes_) travelTimes {};
+    travelTimes.reserve(travelTimes_.size());
+    for (const auto& travelTime : travelTimes_) {
+        const Index stationA {stationMap[static_cast<Index>(travelTime.first >> 32)]};
+        const Index stationB {stationMap[static_cast<Index>(travelTime.first)]};
+        if (stationA == kInvalidIndex || stationB == kInvalidIndex) continue;
+        travelTimes.emplace(MakeEdgeKey(stationA, stationB), travelTime.second);
+    }
+
+    layout_ = std::move(layout);
+    cumulativeTimes_ = std::move(cumulativeTimes);
+    crowdedCosts_.assign(cumulativeTimes_.size(), {});
+    travelTimes_ = std::move(travelTimes);
+    passengerCounts_ = std::move(passengerCounts);
+    flowHistories_ = std::move(flowHistories);
+    flowBuckets_ = std::move(flowBuckets);
+    travelTimeMatrix_.reset();
+    ClearContractionHierarchy();
+    if (wasFrozen) {
+        Freeze();
+    }
+}
+
+void TransportNetwork::IndexRouteStops(const RouteNode& routeNode) {
+    // Only the last route added can be indexed, so that the stop positions
+    // and travel times stay aligned with the route stops.
+    Layout& layout {MutableLayout()};
+    const Index* stops {layout.routeStops.data() + routeNode.stopOffset};
+
+    unsigned int cumulativeTime {0};
+    for (Index j = 0; j < routeNode.stopCount; ++j) {
+        if (j > 0) {
+            cumulativeTime += GetEdgeTravelTime(stops[j - 1], stops[j]);
+        }
+        cumulativeTimes_.push_back(cumulativeTime);
+        crowdedCosts_.emplace_back();
+        layout.stopPositions.emplace_back(stops[j], j);
+    }
+    std::sort(
+        layout.stopPositions.begin() + routeNode.stopOffset,
+        layout.stopPositions.end()
+    );
+}
+
+TransportNetwork::Index TransportNetwork::GetStopPosition(
+    const RouteNode& routeNode,
+    const Index station
+) const {
+    auto first {layout_->stopPositions.begin() + routeNode.stopOffset};
+    auto last {first + routeNode.stopCount};
+    auto it = std::lower_bound(first, last, std::make_pair(station, Index {0}));
+    if (it == last || it->first != station) return kInvalidIndex;
+    return it->second;
+}
+
+TransportNetwork::Layout& TransportNetwork::MutableLayout() {
+    return MakeMutable(layout_);
+}
+
+void TransportNetwork::Freeze() {
+    if (layout_->frozen) return;
+
+    Layout& layout {MutableLayout()};
+
+    layout.edgeOffsets.clear();
+    layout.edgeOffsets.reserve(layout.stations.size() + 1);
+    layout.edgeEnds.clear();
+    layout.edgeEnds.reserve(layout.stations.size());
+    size_t nEdges {0};
+    for (const auto& node : layout.stations) {
+        nEdges += node.edges.size();
+    }
+    layout.edges.clear();
+    layout.edges.reserve(nEdges);
+
+    for (auto& node : layout.stations) {
+        layout.edgeOffsets.push_back(static_cast<std::uint32_t>(layout.edges.size()));
+        layout.edges.insert(layout.edges.end(), node.edges.begin(), node.edges.end());
+        layout.edgeEnds.push_back(static_cast<std::uint32_t>(layout.edges.size()));
+        std::vector<GraphEdge>().swap(node.edges);
+    }
+    layout.edgeOffsets.push_back(static_cast<std::uint32_t>(layout.edges.size()));
+
+    layout.frozen = true;
+}
+
+bool TransportNetwork::IsFrozen() const {
+    return layout_->frozen;
+}
+
+void TransportNetwork::Thaw() {
+    Layout& layout {MutableLayout()};
+    size_t nEdges {0};
+    for (size_t i = 0; i < layout.stations.size(); ++i) {
+        layout.stations[i].edges.assign(
+            layout.edges.begin() + layout.edgeOffsets[i],
+            layout.edges.begin() + layout.edgeEnds[i]
+        );
+        nEdges += layout.stations[i].edges.size();
+    }
+
+    // The dead slots of removed edges go away with the CSR arrays.
+    layout.nTombstones -= layout.edges.size() - nEdges;
+    std::vector<std::uint32_t>().swap(layout.edgeEnds);
+    std::vector<GraphEdge>().swap(layout.edges);
+
+    layout.frozen = false;
+}
+
+bool TransportNetwork::RecordPassengerEvent(const PassengerEvent& event) {
+    Index stationIndex {GetStationIndex(event.stationId)};
+    if (stationIndex == kInvalidIndex) return false;
+
+    switch(event.type) {
+        case PassengerEvent::Type::In:
+            passengerCounts_[stationIndex].value.fetch_add(
+                1, std::memory_order_relaxed
+            );
+            break;
+        case PassengerEvent::Type::Out:
+            passengerCounts_[stationIndex].value.fetch_sub(
+                1, std::memory_order_relaxed
+            );
+            break;
+        default:
+            return false;
+    }
+    if (flowBucketCount_ > 0) {
+        RecordPassengerFlow(stationIndex, event);
+    }
+    return true;
+}
+
+std::vector<size_t> TransportNetwork::RecordPassengerEvents(
+    const std::vector<PassengerEvent>& events
+) {
+    std::vector<size_t> rejected {};
+
+    // Per-thread scratch space, reset through the list of touched stations.
+    thread_local std::vector<long long int> deltas {};
+    thread_local std::vector<Index> touched {};
+    if (deltas.size() < layout_->stations.size()) {
+        deltas.resize(layout_->stations.size(), 0);
+    }
+
+    const Id* previousId {nullptr};
+    Index stationIndex {kInvalidIndex};
+    for (size_t i = 0; i < events.size(); ++i) {
+        const PassengerEvent& event {events[i]};
+        if (previousId == nullptr || event.stationId != *previousId) {
+            stationIndex = GetStationIndex(event.stationId);
+            previousId = &event.stationId;
+        }
+        if (stationIndex == kInvalidIndex) {
+            rejected.push_back(i);
+            continue;
+        }
+
+        long long int delta {0};
+        switch (event.type) {
+            case PassengerEvent::Type::In:
+                delta = 1;
+                break;
+            case PassengerEvent::Type::Out:
+                delta = -1;
+                break;
+            default:
+                rejected.push_back(i);
+                continue;
+        }
+        if (deltas[stationIndex] == 0) {
+            touched.push_back(stationIndex);
+        }
+        deltas[stationIndex] += delta;
+        if (flowBucketCount_ > 0) {
+            RecordPassengerFlow(stationIndex, event);
+        }
+    }
+
+    // A station can appear twice in the touched list if its running delta went
+    // back to 0, which is harmless: the second visit adds 0.
+    for (const Index station : touched) {
+        if (deltas[station] != 0) {
+            passengerCounts_[station].value.fetch_add(
+                deltas[station], std::memory_order_relaxed
+            );
+            deltas[station] = 0;
+        }
+    }
+    touched.clear();
+
+    return rejected;
+}
+
+long long int TransportNetwork::GetPassengerCount(const Id& station) const {
+    Index stationIndex {GetStationIndex(station)};
+    if (stationIndex == kInvalidIndex) throw std::runtime_error("station not found");
+
+    return passengerCounts_[stationIndex].value.load(std::memory_order_relaxed);
+}
+
+long long int TransportNetwork::SumPassengerCounts(
+    std::vector<Index>& stations
+) const {
+    std::sort(stations.begin(), stations.end());
+    stations.erase(std::unique(stations.begin(), stations.end()), stations.end());
+
+    long long int total {0};
+    for (const Index station : stations) {
+        total += passengerCounts_[station].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+long long int TransportNetwork::GetLinePassengerCount(const Id& line) const {
+    auto it {layout_->lineIndices.find(line)};
+    if (it == layout_->lineIndices.end()) throw std::runtime_error("line not found");
+
+    const LineNode& lineNode {layout_->lines[it->second]};
+    std::vector<Index> stations {};
+    for (Index route = lineNode.firstRoute;
+         route < lineNode.firstRoute + lineNode.routeCount; ++route) {
+        const RouteNode& routeNode {layout_->routes[route]};
+        if (routeNode.removed) continue;
+        const auto stops {layout_->routeStops.begin() + routeNode.stopOffset};
+        stations.insert(stations.end(), stops, stops + routeNode.stopCount);
+    }
+    return SumPassengerCounts(stations);
+}
+
+long long int TransportNetwork::GetRoutePassengerCount(const Id& route) const {
+    auto it {layout_->routeIndices.find(route)};
+    if (it == layout_->routeIndices.end()) throw std::runtime_error("route not found");
+
+    const RouteNode& routeNode {layout_->routes[it->second]};
+    const auto stops {layout_->routeStops.begin() + routeNode.stopOffset};
+    std::vector<Index> stations(stops, stops + routeNode.stopCount);
+    return SumPassengerCounts(stations);
+}
+
+std::vector<StationPassengerCount> TransportNetwork::GetMostCrowdedStations(
+    const size_t k
+) const {
+    std::vector<std::pair<long long int, Index>> counts {};
+    counts.reserve(layout_->stations.size());
+    for (Index station = 0; station < layout_->stations.size(); ++station) {
+        if (layout_->stations[station].removed) continue;
+        counts.emplace_back(
+            passengerCounts_[station].value.load(std::memory_order_relaxed),
+            station
+        );
+    }
+
+    const size_t n {std::min(k, counts.size())};
+    std::partial_sort(
+        counts.begin(), counts.begin() + n, counts.end(),
+        [](const auto& a, const auto& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        }
+    );
+
+    std::vector<StationPassengerCount> stations {};
+    stations.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        stations.push_back({
+            Id {layout_->stations[counts[i].second].stationId},
+            counts[i].first
+        });
+    }
+    return stations;
+}
+
+std::vector<std::string_view> TransportNetwork::GetStationIds() const {
+    std::vector<std::string_view> ids {};
+    ids.reserve(layout_->stations.size());
+    for (const auto& node : layout_->stations) {
+        ids.push_back(node.removed ? std::string_view {} : node.stationId);
+    }
+    return ids;
+}
+
+size_t TransportNetwork::ExportPassengerCounts(
+    long long int* counts,
+    const size_t size
+) const {
+    const size_t nStations {layout_->stations.size()};
+    const size_t n {std::min(size, nStations)};
+    for (size_t station = 0; station < n; ++station) {
+        counts[station] = layout_->stations[station].removed ? 0 :
+            passengerCounts_[station].value.load(std::memory_order_relaxed);
+    }
+    return nStations;
+}
+
+void TransportNetwork::SetPassengerFlowHistory(
+    const std::chrono::seconds bucketWidth,
+    const size_t nBuckets
+) {
+    flowBucketWidth_ = bucketWidth;
+    flowBucketCount_ = bucketWidth.count() > 0 ? nBuckets : 0;
+    flowHistories_.assign(flowBucketCount_ > 0 ? layout_->stations.size() : 0, {});
+    flowBuckets_.assign(layout_->stations.size() * flowBucketCount_, {});
+}
+
+PassengerFlow TransportNetwork::GetPassengerFlow(
+    const Id& station,
+    const std::chrono::seconds window,
+    const std::chrono::system_clock::time_point now
+) const {
+    Index stationIndex {GetStationIndex(station)};
+    if (stationIndex == kInvalidIndex) throw std::runtime_error("station not found");
+
+    PassengerFlow flow {};
+    if (flowBucketCount_ == 0) return flow;
+
+    const FlowHistory& history {flowHistories_[stationIndex]};
+    const FlowBucket* buckets {
+        flowBuckets_.data() + stationIndex * flowBucketCount_
+    };
+    const long long int nBuckets {static_cast<long long int>(flowBucketCount_)};
+    const long long int width {flowBucketWidth_.count()};
+    const long long int last {
+        std::chrono::duration_cast<std::chrono::seconds>(
+            now.time_since_epoch()
+        ).count() / width
+    };
+    const long long int first {last - (window.count() + width - 1) / width};
+
+    std::lock_guard<std::mutex> lock {history.mutex};
+    if (history.head == FlowHistory::kEmpty) return flow;
+
+    // Running totals at the end of a bucket. Buckets newer than the head have
+    // seen no events yet; buckets older than the ring are clamped to it.
+    auto totalsAt = [&](long long int bucket) -> const FlowBucket& {
+        bucket = std::min(bucket, history.head);
+        bucket = std::max(bucket, history.head - nBuckets + 1);
+        return buckets[((bucket % nBuckets) + nBuckets) % nBuckets];
+    };
+    if (last < history.head - nBuckets + 1) return flow;
+    const FlowBucket& end {totalsAt(last)};
+    const FlowBucket& start {totalsAt(first)};
+    flow.in = end.in - start.in;
+    flow.out = end.out - start.out;
+    return flow;
+}
+
+void TransportNetwork::RecordPassengerFlow(
+    const Index station,
+    const PassengerEvent& event
+) {
+    const auto timestamp {
+        event.timestamp == std::chrono::system_clock::time_point {} ?
+            std::chrono::system_clock::now() : event.timestamp
+    };
+    const long long int bucket {
+        std::chrono::duration_cast<std::chrono::seconds>(
+            timestamp.time_since_epoch()
+        ).count() / flowBucketWidth_.count()
+    };
+
+    FlowHistory& history {flowHistories_[station]};
+    FlowBucket* buckets {flowBuckets_.data() + station * flowBucketCount_};
+    const long long int nBuckets {static_cast<long long int>(flowBucketCount_)};
+
+    auto at = [buckets, nBuckets](const long long int b) -> FlowBucket& {
+        return buckets[((b % nBuckets) + nBuckets) % nBuckets];
+    };
+
+    std::lock_guard<std::mutex> lock {history.mutex};
+
+    // The first event fills the ring with empty buckets, so that every bucket
+    // it covers is always valid.
+    if (history.head == FlowHistory::kEmpty) {
+        for (long long int b = bucket - nBuckets + 1; b <= bucket; ++b) {
+            at(b) = {b, 0, 0};
+        }
+        history.head = bucket;
+    }
+
+    // Moving forward in time carries the running totals over to the new
+    // buckets, overwriting the oldest ones.
+    if (bucket > history.head) {
+        const FlowBucket totals {at(history.head)};
+        const long long int from {
+            std::max(history.head + 1, bucket - nBuckets + 1)
+        };
+        for (long long int b = from; b <= bucket; ++b) {
+            at(b) = {b, totals.in, totals.out};
+        }
+        history.head = bucket;
+    }
+
+    // Late events older than the ring are dropped; others are added to the
+    // running totals of every bucket from theirs to the newest one.
+    if (bucket <= history.head - nBuckets) return;
+    for (long long int b = bucket; b <= history.head; ++b) {
+        FlowBucket& totals {at(b)};
+        if (event.type == PassengerEvent::Type::In) {
+            ++totals.in;
+        } else {
+            ++totals.out;
+        }
+    }
+}
+
+std::string_view TransportNetwork::GetStationName(const Id& station) const {
+    const Index stationIndex {GetStationIndex(station)};
+    if (stationIndex == kInvalidIndex) return {};
+    return layout_->stations[stationIndex].name;
+}
+
+std::string_view TransportNetwork::GetLineName(const Id& line) const {
+    auto it {layout_->lineIndices.find(line)};
+    if (it == layout_->lineIndices.end()) return {};
+    return layout_->lines[it->second].name;
+}
+
+std::string_view TransportNetwork::GetRouteDirection(const Id& route) const {
+    auto it {layout_->routeIndices.find(route)};
+    if (it == layout_->routeIndices.end()) return {};
+    return layout_->routes[it->second].direction;
+}
+
+std::vector<Id> TransportNetwork::GetRoutesServingStation(const Id& station) const {
+    std::vector<Id> result {};
+
+    Index stationIndex {GetStationIndex(station)};
+    if (stationIndex == kInvalidIndex) return result;
+
+    const auto& routes {layout_->stations[stationIndex].routes};
+    result.reserve(routes.size());
+    for (const Index routeIndex : routes) {
+        result.emplace_back(layout_->routes[routeIndex].id);
+    }
+
+    return result;
+}
+
+bool TransportNetwork::SetTravelTime(
+    const Id& stationA,
+    const Id& stationB,
+    const unsigned int travelTime
+) {
+    Index indexA {GetStationIndex(stationA)};
+    if (indexA == kInvalidIndex) return false;
+    Index indexB {GetStationIndex(stationB)};
+    if (indexB == kInvalidIndex) return false;
+
+    if (AreAdjacent(indexA, indexB)) {
+        SetEdgeTravelTime(indexA, indexB, travelTime);
+        return true;
+    }
+    return false;
+}
+
+void TransportNetwork::SetEdgeTravelTime(
+    const Index stationA,
+    const Index stationB,
+    const unsigned int travelTime
+) {
+    unsigned int& storedTime {travelTimes_[MakeEdgeKey(stationA, stationB)]};
+    const unsigned int oldTime {storedTime};
+    storedTime = travelTime;
+    if (oldTime == travelTime) return;
+
+    UpdateRouteTravelTimes(stationA, stationB, oldTime, travelTime);
+    if (HasTravelTimeMatrix()) {
+        UpdateTravelTimeMatrix({{stationA, stationB, oldTime, travelTime}});
+    }
+    ClearContractionHierarchy();
+}
+
+std::vector<size_t> TransportNetwork::SetTravelTimes(
+    const std::vector<TravelTime>& travelTimes
+) {
+    std::vector<size_t> rejected {};
+
+    // Station IDs are resolved once per run of entries from the same station.
+    std::vector<std::pair<EdgeKey, size_t>> updates {};
+    updates.reserve(travelTimes.size());
+    const Id* previousId {nullptr};
+    Index indexA {kInvalidIndex};
+    for (size_t i = 0; i < travelTimes.size(); ++i) {
+        const TravelTime& item {travelTimes[i]};
+        if (previousId == nullptr || item.startStationId != *previousId) {
+            indexA = GetStationIndex(item.startStationId);
+            previousId = &item.startStationId;
+        }
+        const Index indexB {GetStationIndex(item.endStationId)};
+        if (indexA == kInvalidIndex || indexB == kInvalidIndex) {
+            rejected.push_back(i);
+            continue;
+        }
+        updates.emplace_back(MakeEdgeKey(indexA, indexB), i);
+    }
+
+    // Sorting by edge, then by position, groups the updates of each edge with
+    // the one that wins last.
+    std::sort(updates.begin(), updates.end());
+    std::vector<TravelTimeChange> changes {};
+    for (size_t first = 0; first < updates.size();) {
+        const EdgeKey key {updates[first].first};
+        size_t last {first};
+        while (last + 1 < updates.size() && updates[last + 1].first == key) {
+            ++last;
+        }
+
+        const auto stationA {static_cast<Index>(key >> 32)};
+        const auto stationB {static_cast<Index>(key)};
+        if (!AreAdjacent(stationA, stationB)) {
+            for (size_t i = first; i <= last; ++i) {
+                rejected.push_back(updates[i].second);
+            }
+        } else {
+            const unsigned int travelTime {
+                travelTimes[updates[last].second].travelTime
+            };
+            unsigned int& storedTime {travelTimes_[key]};
+            if (storedTime != travelTime) {
+                changes.push_back({stationA, stationB, storedTime, travelTime});
+                storedTime = travelTime;
+            }
+        }
+        first = last + 1;
+    }
+    std::sort(rejected.begin(), rejected.end());
+    if (changes.empty()) return rejected;
+
+    // Recompute each affected route once, however many of its edges changed.
+    std::vector<Index> routes {};
+    for (const auto& change : changes) {
+        for (const Index routeIndex : layout_->stations[change.stationA].routes) {
+            const RouteNode& routeNode {layout_->routes[routeIndex]};
+            const Index posB {GetStopPosition(routeNode, change.stationB)};
+            if (posB == kInvalidIndex) continue;
+            const Index posA {GetStopPosition(routeNode, change.stationA)};
+            if (posA + 1 == posB || posB + 1 == posA) {
+                routes.push_back(routeIndex);
+            }
+        }
+    }
+    std::sort(routes.begin(), routes.end());
+    routes.erase(std::unique(routes.begin(), routes.end()), routes.end());
+    for (const Index routeIndex : routes) {
+        ComputeCumulativeTimes(layout_->routes[routeIndex]);
+        ClearCrowdedCosts(layout_->routes[routeIndex]);
+    }
+
+    UpdateTravelTimeMatrix(changes);
+    ClearContractionHierarchy();
+    return rejected;
+}
+
+void TransportNetwork::ComputeCumulativeTimes(const RouteNode& routeNode) {
+    const Index* stops {layout_->routeStops.data() + routeNode.stopOffset};
+    unsigned int* cumulativeTimes {cumulativeTimes_.data() + routeNode.stopOffset};
+    for (Index j = 1; j < routeNode.stopCount; ++j) {
+        cumulativeTimes[j] = cumulativeTimes[j - 1] +
+            GetEdgeTravelTime(stops[j - 1], stops[j]);
+    }
+}
+
+unsigned int TransportNetwork::GetTravelTime(const Id& stationA,
+     const Id& stationB
+    ) const {
+    Index indexA {GetStationIndex(stationA)};
+    if (indexA == kInvalidIndex) return 0;
+    Index indexB {GetStationIndex(stationB)};
+    if (indexB == kInvalidIndex) return 0;
+
+    return GetEdgeTravelTime(indexA, indexB);
+}
+
+unsigned int TransportNetwork::GetTravelTime(
+    const Id& line,
+    const Id& route,
+    const Id& stationA,
+    const Id& stationB
+) const {
+    if (layout_->lineIndices.count(line) == 0) return 0;
+    auto routeIt {layout_->routeIndices.find(route)};
+    if (routeIt == layout_->routeIndices.end()) return 0;
+    if (stationA == stationB) return 0;
+
+    const RouteNode& r = layout_->routes[routeIt->second];
+
+    const Index posA {GetStopPosition(r, GetStationIndex(stationA))};
+    if (posA == kInvalidIndex) return 0;
+    const Index posB {GetStopPosition(r, GetStationIndex(stationB))};
+    if (posB == kInvalidIndex) return 0;
+
+    if (posA >= posB) return 0;
+
+    return cumulativeTimes_[r.stopOffset + posB] -
+        cumulativeTimes_[r.stopOffset + posA];
+}
+
+unsigned int TransportNetwork::GetEdgeTravelTime(
+    const Index stationA,
+    const Index stationB
+) const {
+    if (stationA == stationB) return 0;
+
+    auto it = travelTimes_.find(MakeEdgeKey(stationA, stationB));
+    if (it != travelTimes_.end()) {
+        return it->second;
+    }
+    return 0;
+}
+
+void TransportNetwork::UpdateRouteTravelTimes(
+    const Index stationA,
+    const Index stationB,
+    const unsigned int oldTravelTime,
+    const unsigned int newTravelTime
+) {
+    if (oldTravelTime == newTravelTime) return;
+
+    // Unsigned arithmetic wraps around, so adding the difference also works
+    // when the travel time decreases.
+    const unsigned int delta {newTravelTime - oldTravelTime};
+
+    // Only routes serving both stations, with the two stops next to each
+    // other, include this edge.
+    for (const Index routeIndex : layout_->stations[stationA].routes) {
+        const RouteNode& routeNode {layout_->routes[routeIndex]};
+        const Index posB {GetStopPosition(routeNode, stationB)};
+        if (posB == kInvalidIndex) continue;
+        const Index posA {GetStopPosition(routeNode, stationA)};
+
+        Index next {0};
+        if (posA + 1 == posB) {
+            next = posB;
+        } else if (posB + 1 == posA) {
+            next = posA;
+        } else {
+            continue;
+        }
+        for (Index i = next; i < routeNode.stopCount; ++i) {
+            cumulativeTimes_[routeNode.stopOffset + i] += delta;
+        }
+        crowdedCosts_[routeNode.stopOffset + next].value.store(
+            0, std::memory_order_relaxed
+        );
+    }
+}
+
+TravelRoute TransportNetwork::GetFastestPath(
+    const Id& stationA,
+    const Id& stationB,
+    const unsigned int changeRoutePenalty
+) const {
+    return SearchFastestPath(stationA, stationB, changeRoutePenalty, false);
+}
+
+void TransportNetwork::SetCrowdingCost(
+    std::vector<long long int> thresholds,
+    CrowdingCost cost
+) {
+    std::sort(thresholds.begin(), thresholds.end());
+    crowdingThresholds_ = std::move(thresholds);
+    crowdingCost_ = std::move(cost);
+    crowdedCosts_.assign(crowdedCosts_.size(), {});
+}
+
+size_t TransportNetwork::GetCrowdingLevel(const Index station) const {
+    const long long int count {
+        passengerCounts_[station].value.load(std::memory_order_relaxed)
+    };
+    return static_cast<size_t>(std::upper_bound(
+        crowdingThresholds_.begin(), crowdingThresholds_.end(), count
+    ) - crowdingThresholds_.begin());
+}
+
+unsigned int TransportNetwork::GetCrowdedCost(
+    const Index stop,
+    const unsigned int travelTime
+) const {
+    if (!crowdingCost_) return travelTime;
+
+    // Concurrent queries may both compute a missing entry. They store the
+    // same value, so the race is harmless.
+    const size_t level {GetCrowdingLevel(layout_->routeStops[stop])};
+    const std::uint64_t tag {static_cast<std::uint64_t>(level + 1) << 32};
+    std::atomic<std::uint64_t>& entry {crowdedCosts_[stop].value};
+    const std::uint64_t cached {entry.load(std::memory_order_relaxed)};
+    if ((cached & ~0xffffffffULL) == tag) {
+        return static_cast<unsigned int>(cached);
+    }
+    const unsigned int cost {crowdingCost_(travelTime, level)};
+    entry.store(tag | cost, std::memory_order_relaxed);
+    return cost;
+}
+
+void TransportNetwork::ClearCrowdedCosts(const RouteNode& routeNode) {
+    for (Index j = 0; j < routeNode.stopCount; ++j) {
+        crowdedCosts_[routeNode.stopOffset + j].value.store(
+            0, std::memory_order_relaxed
+        );
+    }
+}
+
+unsigned int TransportNetwork::GetCrowdedTravelTime(
+    const Id& stationA,
+    const Id& stationB
+) const {
+    const Index indexA {GetStationIndex(stationA)};
+    const Index indexB {GetStationIndex(stationB)};
+    if (indexA == kInvalidIndex || indexB == kInvalidIndex) return 0;
+    if (indexA == indexB || !AreAdjacent(indexA, indexB)) return 0;
+
+    const unsigned int travelTime {GetEdgeTravelTime(indexA, indexB)};
+    if (!crowdingCost_) return travelTime;
+    return crowdingCost_(travelTime, GetCrowdingLevel(indexB));
+}
+
+TravelRoute TransportNetwork::GetLeastCrowdedPath(
+    const Id& stationA,
+    const Id& stationB,
+    const unsigned int changeRoutePenalty
+) const {
+    return SearchFastestPath(stationA, stationB, changeRoutePenalty, true);
+}
+
+TravelRoute TransportNetwork::SearchFastestPath(
+    const Id& stationA,
+    const Id& stationB,
+    const unsigned int changeRoutePenalty,
+    const bool crowded
+) const {
+    TravelRoute travelRoute {};
+    travelRoute.startStationId = stationA;
+    travelRoute.endStationId = stationB;
+
+    const Index source {GetStationIndex(stationA)};
+    const Index target {GetStationIndex(stationB)};
+    if (source == kInvalidIndex || target == kInvalidIndex) return travelRoute;
+    if (source == target) return travelRoute;
+
+    // The search runs over two kinds of nodes:
+    // - One node per (route, stop) pair, numbered as in layout_->routeStops.
+    //   Riding to the next stop costs the edge travel time.
+    // - One node per station, numbered stopCount + station index. Getting off
+    //   a route costs the penalty, boarding any route at the station is free.
+    // Every change of route goes through a station node, so it pays the
+    //   penalty exactly once.
+    const Index stopCount {static_cast<Index>(layout_->routeStops.size())};
+    const Index nNodes {stopCount + static_cast<Index>(layout_->stations.size())};
+    const unsigned int unreached {std::numeric_limits<unsigned int>::max()};
+    std::vector<unsigned int> distances(nNodes, unreached);
+    std::vector<Index> previous(nNodes, kInvalidIndex);
+    std::vector<Index> nodeRoutes(nNodes, kInvalidIndex);
+
+    using QueueItem = std::pair<unsigned int, Index>;
+    std::priority_queue<
+        QueueItem,
+        std::vector<QueueItem>,
+        std::greater<QueueItem>
+    > queue {};
+
+    auto relax = [&](
+        const Index from,
+        const Index to,
+        const Index route,
+        const unsigned int distance
+    ) {
+        if (distance < distances[to]) {
+            distances[to] = distance;
+            previous[to] = from;
+            nodeRoutes[to] = route;
+            queue.emplace(distance, to);
+        }
+    };
+
+    distances[stopCount + source] = 0;
+    queue.emplace(0, stopCount + source);
+
+    Index found {kInvalidIndex};
+    while (!queue.empty()) {
+        const QueueItem item {queue.top()};
+        queue.pop();
+        const unsigned int distance {item.first};
+        const Index node {item.second};
+        if (distance > distances[node]) continue;
+
+        if (node >= stopCount) {
+            const Index station {node - stopCount};
+            for (const Index routeIndex : layout_->stations[station].routes) {
+                const RouteNode& routeNode {layout_->routes[routeIndex]};
+                relax(
+                    node,
+                    routeNode.stopOffset + GetStopPosition(routeNode, station),
+                    routeIndex,
+                    distance
+                );
+            }
+            continue;
+        }
+
+        const RouteNode& routeNode {layout_->routes[nodeRoutes[node]]};
+        const Index position {node - routeNode.stopOffset};
+        const Index station {layout_->routeStops[node]};
+        if (station == target) {
+            found = node;
+            break;
+        }
+        if (position + 1 < routeNode.stopCount) {
+            const unsigned int travelTime {
+                cumulativeTimes_[node + 1] - cumulativeTimes_[node]
+            };
+            relax(
+                node,
+                node + 1,
+                nodeRoutes[node],
+                distance + (crowded ? GetCrowdedCost(node + 1, travelTime) : travelTime)
+            );
+        }
+        relax(node, stopCount + station, kInvalidIndex,
+              distance + changeRoutePenalty);
+    }
+    if (found == kInvalidIndex) return travelRoute;
+
+    // Walk back the ride steps; station nodes only mark route changes.
+    for (Index node {found}; previous[node] != kInvalidIndex;
+         node = previous[node]) {
+        const Index from {previous[node]};
+        if (node >= stopCount || from >= stopCount) continue;
+
+        const RouteNode& routeNode {layout_->routes[nodeRoutes[node]]};
+        TravelRoute::Step step {};
+        step.startStationId = Id {layout_->stations[layout_->routeStops[from]].stationId};
+        step.endStationId = Id {layout_->stations[layout_->routeStops[node]].stationId};
+        step.lineId = Id {layout_->lines[routeNode.lineIndex].id};
+        step.routeId = Id {routeNode.id};
+        step.travelTime = cumulativeTimes_[node] - cumulativeTimes_[from];
+        travelRoute.totalTravelTime += step.travelTime;
+        travelRoute.steps.push_back(std::move(step));
+    }
+    std::reverse(travelRoute.steps.begin(), travelRoute.steps.end());
+
+    return travelRoute;
+}
+
+// Search state of GetAlternativeRoutes and GetReachableStations, reused
+// across the queries of a thread. Every search takes a new epoch: a station's
+// travel time is only valid if it was stamped with the current epoch, so
+// starting a search never clears the arrays.
+struct TransportNetwork::PathSearch {
+    // Stops of a journey: stops[offset] to stops[offset + length].
+    struct Path {
+        unsigned int travelTime {0};
+        size_t offset {0};
+        size_t length {0};
+    };
+
+    std::uint32_t epoch {0};
+    std::vector<std::uint32_t> stamps {};
+    std::vector<unsigned int> travelTimes {};
+    std::vector<Index> previous {};
+    std::vector<std::pair<unsigned int, Index>> queue {};
+
+    // Stations excluded from the current search, stamped with its epoch, and
+    // stations the search source must not go to next.
+    std::vector<std::uint32_t> excluded {};
+    std::vector<Index> excludedNext {};
+
+    std::vector<Index> stops {};
+    std::vector<Path> paths {};
+    std::vector<Path> candidates {};
+
+    void Prepare(const size_t nStations)
+    {
+        if (stamps.size() < nStations) {
+            stamps.resize(nStations, 0);
+            travelTimes.resize(nStations, 0);
+            previous.resize(nStations, 0);
+            excluded.resize(nStations, 0);
+        }
+        stops.clear();
+        paths.clear();
+        candidates.clear();
+    }
+
+    void NextEpoch()
+    {
+        if (++epoch == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            std::fill(excluded.begin(), excluded.end(), 0);
+            epoch = 1;
+        }
+        excludedNext.clear();
+    }
+
+    bool IsSamePath(const Path& a, const Path& b) const
+    {
+        return a.length == b.length && std::equal(
+            stops.begin() + a.offset,
+            stops.begin() + a.offset + a.length,
+            stops.begin() + b.offset
+        );
+    }
+};
 
-TransportNetwork::TransportNetwork() = default;
+unsigned int TransportNetwork::SearchPath(
+    const Index source,
+    const Index target,
+    PathSearch& search
+) const {
+    const auto later = std::greater<std::pair<unsigned int, Index>>();
+    search.queue.clear();
+    search.stamps[source] = search.epoch;
+    search.travelTimes[source] = 0;
+    search.previous[source] = kInvalidIndex;
+    search.queue.emplace_back(0, source);
 
-TransportNetwork::~TransportNetwork() = default;
+    while (!search.queue.empty()) {
+        std::pop_heap(search.queue.begin(), search.queue.end(), later);
+        const auto item {search.queue.back()};
+        search.queue.pop_back();
+        const unsigned int travelTime {item.first};
+        const Index station {item.second};
+        if (travelTime > search.travelTimes[station]) continue;
+        if (station == target) return travelTime;
 
-bool Station::operator==(const Station& other) const {
-    return id == other.id;
+        for (const auto& neighbor : layout_->stations[station].neighbors) {
+            if (neighbor.nEdgesOut == 0 ||
+                search.excluded[neighbor.station] == search.epoch) {
+                continue;
+            }
+            if (station == source && std::find(
+                    search.excludedNext.begin(), search.excludedNext.end(),
+                    neighbor.station
+                ) != search.excludedNext.end()) {
+                continue;
+            }
+            const unsigned int nextTravelTime {
+                travelTime + GetEdgeTravelTime(station, neighbor.station)
+            };
+            if (search.stamps[neighbor.station] != search.epoch ||
+                nextTravelTime < search.travelTimes[neighbor.station]) {
+                search.stamps[neighbor.station] = search.epoch;
+                search.travelTimes[neighbor.station] = nextTravelTime;
+                search.previous[neighbor.station] = station;
+                search.queue.emplace_back(nextTravelTime, neighbor.station);
+                std::push_heap(search.queue.begin(), search.queue.end(), later);
+            }
+        }
+    }
+    return kUnreachable;
 }
 
-bool Line::operator==(const Line& other) const {
-    return id == other.id;
-}
+std::vector<TravelRoute> TransportNetwork::GetAlternativeRoutes(
+    const Id& stationA,
+    const Id& stationB,
+    const size_t k
+) const {
+    std::vector<TravelRoute> travelRoutes {};
 
-bool Route::operator==(const Route& other) const {
-    return id == other.id;
-}
+    const Index source {GetStationIndex(stationA)};
+    const Index target {GetStationIndex(stationB)};
+    if (source == kInvalidIndex || target == kInvalidIndex) return travelRoutes;
+    if (source == target || k == 0) return travelRoutes;
 
-TransportNetwork::TransportNetwork(const TransportNetwork& copied) = default;
-TransportNetwork::TransportNetwork(TransportNetwork&& moved) = default;
+    thread_local PathSearch search {};
+    search.Prepare(layout_->stations.size());
+    using Path = PathSearch::Path;
 
-TransportNetwork& TransportNetwork::operator=(const TransportNetwork& copied) = default;
-TransportNetwork& TransportNetwork::operator=(TransportNetwork&& moved) = default;
+    // Store the first `rootLength` stops of `root` followed by the stops the
+    // last search found up to the target.
+    auto appendPath = [this, target](
+        const Path& root,
+        const size_t rootLength,
+        const unsigned int travelTime
+    ) {
+        Path path {travelTime, search.stops.size(), rootLength};
+        for (size_t j = 0; j < rootLength; ++j) {
+            search.stops.push_back(search.stops[root.offset + j]);
+        }
+        const size_t spurOffset {search.stops.size()};
+        for (Index station {target}; station != kInvalidIndex;
+             station = search.previous[station]) {
+            search.stops.push_back(station);
+        }
+        std::reverse(search.stops.begin() + spurOffset, search.stops.end());
+        path.length = search.stops.size() - path.offset;
+        return path;
+    };
 
+    search.NextEpoch();
+    const unsigned int travelTime {SearchPath(source, target, search)};
+    if (travelTime == kUnreachable) return travelRoutes;
+    search.paths.push_back(appendPath({}, 0, travelTime));
 
-bool TransportNetwork::AddStation(const Station& station) {
-    if (stations_.count(station.id) > 0) return false;
+    while (search.paths.size() < k) {
+        // Deviate from the last journey found at each of its stations. The
+        // stations before the deviation are excluded, and so are the next
+        // stations of the journeys found so far that share the same start.
+        const Path last {search.paths.back()};
+        unsigned int rootTravelTime {0};
+        for (size_t i = 0; i + 1 < last.length; ++i) {
+            const Index spur {search.stops[last.offset + i]};
+            if (i > 0) {
+                rootTravelTime += GetEdgeTravelTime(
+                    search.stops[last.offset + i - 1], spur
+                );
+            }
 
-    GraphNode node;
-    node.stationId = station.id;
-    node.name = station.name;
-    node.passengerCount = 0;
+            search.NextEpoch();
+            for (size_t j = 0; j < i; ++j) {
+                search.excluded[search.stops[last.offset + j]] = search.epoch;
+            }
+            for (const Path& path : search.paths) {
+                if (path.length > i + 1 && std::equal(
+                        search.stops.begin() + path.offset,
+                        search.stops.begin() + path.offset + i + 1,
+                        search.stops.begin() + last.offset
+                    )) {
+                    search.excludedNext.push_back(
+                        search.stops[path.offset + i + 1]
+                    );
+                }
+            }
 
-    stations_[station.id] = node;
-    return true;
-}
+            const unsigned int spurTravelTime {SearchPath(spur, target, search)};
+            if (spurTravelTime == kUnreachable) continue;
 
-bool TransportNetwork::AddLine(const Line& line) {
-    if (lines_.count(line.id) > 0) return false;
+            const Path candidate {
+                appendPath(last, i, rootTravelTime + spurTravelTime)
+            };
+            const bool isKnown {std::any_of(
+                search.candidates.begin(), search.candidates.end(),
+                [&candidate](const Path& other) {
+                    return search.IsSamePath(candidate, other);
+                }
+            )};
+            if (isKnown) {
+                search.stops.resize(candidate.offset);
+            } else {
+                search.candidates.push_back(candidate);
+            }
+        }
+        if (search.candidates.empty()) break;
 
-    for (size_t i = 0; i < line.routes.size(); ++i) {
-        if (routes_.count(line.routes[i].id) > 0) return false;
+        // The fastest candidate is the next journey.
+        auto next = std::min_element(
+            search.candidates.begin(), search.candidates.end(),
+            [](const Path& a, const Path& b) {
+                return a.travelTime < b.travelTime;
+            }
+        );
+        search.paths.push_back(*next);
+        search.candidates.erase(next);
+    }
+
+    // Each step rides the route of the previous step if it goes on to the
+    // next station, or else the first route that does.
+    travelRoutes.reserve(search.paths.size());
+    for (const Path& path : search.paths) {
+        TravelRoute travelRoute {};
+        travelRoute.startStationId = stationA;
+        travelRoute.endStationId = stationB;
+        travelRoute.totalTravelTime = path.travelTime;
+        travelRoute.steps.reserve(path.length - 1);
 
-        for (const Id& stationid : line.routes[i].stops) {
-            if (stations_.count(stationid) == 0) return false;
+        Index routeIndex {kInvalidIndex};
+        for (size_t j = 0; j + 1 < path.length; ++j) {
+            const Index from {search.stops[path.offset + j]};
+            const Index to {search.stops[path.offset + j + 1]};
+            const GraphEdge* edge {nullptr};
+            for (const auto& other : GetEdges(from)) {
+                if (other.nextStationIndex != to) continue;
+                if (edge == nullptr || other.routeIndex == routeIndex) {
+                    edge = &other;
+                }
+            }
+            routeIndex = edge->routeIndex;
 
+            TravelRoute::Step step {};
+            step.startStationId = Id {layout_->stations[from].stationId};
+            step.endStationId = Id {layout_->stations[to].stationId};
+            step.lineId = Id {layout_->lines[edge->lineIndex].id};
+            step.routeId = Id {layout_->routes[routeIndex].id};
+            step.travelTime = GetEdgeTravelTime(from, to);
+            travelRoute.steps.push_back(std::move(step));
         }
+        travelRoutes.push_back(std::move(travelRoute));
+    }
+    return travelRoutes;
+}
 
-        for (size_t j = 0; j < line.routes[i].stops.size() - 1; ++j) {
-            Id curStation = line.routes[i].stops[j];
-            Id nextStation = line.routes[i].stops[j+1];
+std::vector<ReachableStation> TransportNetwork::GetReachableStations(
+    const Id& station,
+    const unsigned int maxTravelTime
+) const {
+    std::vector<ReachableStation> reachable {};
 
-            GraphEdge edge;
-            edge.lineId = line.routes[i].lineId;
-            edge.routeId = line.routes[i].id;
-            edge.nextStationId = nextStation;
+    const Index source {GetStationIndex(station)};
+    if (source == kInvalidIndex) return reachable;
 
-            stations_[curStation].edges.push_back(edge);
+    thread_local PathSearch search {};
+    search.Prepare(layout_->stations.size());
+    search.NextEpoch();
+
+    // Stations further than the budget are never queued, so the search ends
+    // with the last station within the budget.
+    const auto later = std::greater<std::pair<unsigned int, Index>>();
+    search.queue.clear();
+    search.stamps[source] = search.epoch;
+    search.travelTimes[source] = 0;
+    search.queue.emplace_back(0, source);
+
+    while (!search.queue.empty()) {
+        std::pop_heap(search.queue.begin(), search.queue.end(), later);
+        const auto item {search.queue.back()};
+        search.queue.pop_back();
+        const unsigned int travelTime {item.first};
+        const Index current {item.second};
+        if (travelTime > search.travelTimes[current]) continue;
+        if (current != source) {
+            reachable.push_back({
+                Id {layout_->stations[current].stationId},
+                travelTime
+            });
         }
 
-        routes_[line.routes[i].id] = line.routes[i];
+        for (const auto& neighbor : layout_->stations[current].neighbors) {
+            if (neighbor.nEdgesOut == 0) continue;
+            const unsigned int edgeTravelTime {
+                GetEdgeTravelTime(current, neighbor.station)
+            };
+            if (edgeTravelTime > maxTravelTime - travelTime) continue;
+            const unsigned int nextTravelTime {travelTime + edgeTravelTime};
+            if (search.stamps[neighbor.station] != search.epoch ||
+                nextTravelTime < search.travelTimes[neighbor.station]) {
+                search.stamps[neighbor.station] = search.epoch;
+                search.travelTimes[neighbor.station] = nextTravelTime;
+                search.queue.emplace_back(nextTravelTime, neighbor.station);
+                std::push_heap(search.queue.begin(), search.queue.end(), later);
+            }
+        }
     }
-    
-    lines_[line.id] = line;
-    
-    return true;
+    return reachable;
 }
 
-bool TransportNetwork::RecordPassengerEvent(const PassengerEvent& event) {
-    if (stations_.count(event.stationId) == 0) return false;
+unsigned int TransportNetwork::GetFastestTravelTime(
+    const Id& stationA,
+    const Id& stationB
+) const {
+    const Index source {GetStationIndex(stationA)};
+    if (source == kInvalidIndex) return 0;
+    const Index target {GetStationIndex(stationB)};
+    if (target == kInvalidIndex) return 0;
 
-    switch(event.type) {
-        case PassengerEvent::Type::In:
-            stations_[event.stationId].passengerCount++;
-            break;
-        case PassengerEvent::Type::Out:
-            stations_[event.stationId].passengerCount--;
-            break;
+    unsigned int travelTime {kUnreachable};
+    if (HasTravelTimeMatrix()) {
+        travelTime = (*travelTimeMatrix_)[source * layout_->stations.size() + target];
+    } else if (HasContractionHierarchy()) {
+        travelTime = QueryContractionHierarchy(source, target);
+    } else {
+        std::vector<unsigned int> travelTimes(layout_->stations.size());
+        ComputeTravelTimes(source, travelTimes.data());
+        travelTime = travelTimes[target];
     }
-    return true;
+    return travelTime == kUnreachable ? 0 : travelTime;
 }
 
-long long int TransportNetwork::GetPassengerCount(const Id& station) const {
-    if (stations_.count(station) == 0) throw std::runtime_error("station not found");
+void TransportNetwork::BuildTravelTimeMatrix(const unsigned int nThreads) {
+    travelTimeMatrixThreads_ = nThreads > 0 ? nThreads : std::max(
+        std::thread::hardware_concurrency(), 1u
+    );
+    const size_t nStations {layout_->stations.size()};
+    auto matrix {std::make_shared<std::vector<unsigned int>>(
+        nStations * nStations, kUnreachable
+    )};
 
-    return stations_.at(station).passengerCount;
+    std::vector<Index> sources(nStations);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        sources[i] = static_cast<Index>(i);
+    }
+    ComputeTravelTimeMatrixRows(sources, matrix->data(), travelTimeMatrixThreads_);
+    travelTimeMatrix_ = std::move(matrix);
+}
 
-    
+bool TransportNetwork::HasTravelTimeMatrix() const {
+    return !layout_->stations.empty() && travelTimeMatrix_ != nullptr;
 }
 
-std::vector<Id> TransportNetwork::GetRoutesServingStation(const Id& station) const {
-    std::vector<Id> result {};
+void TransportNetwork::ComputeTravelTimes(
+    const Index source,
+    unsigned int* travelTimes
+) const {
+    std::fill(travelTimes, travelTimes + layout_->stations.size(), kUnreachable);
 
-    if (stations_.count(station) == 0) return result;
+    using QueueItem = std::pair<unsigned int, Index>;
+    std::priority_queue<
+        QueueItem,
+        std::vector<QueueItem>,
+        std::greater<QueueItem>
+    > queue {};
 
-    for (const auto& route : routes_) {
-        auto it = std::find(route.second.stops.begin(), route.second.stops.end(), station); //.second because it is a pair of id,route
-        if (it != route.second.stops.end()) {
-            result.push_back(route.first);
+    travelTimes[source] = 0;
+    queue.emplace(0, source);
+    while (!queue.empty()) {
+        const QueueItem item {queue.top()};
+        queue.pop();
+        const unsigned int travelTime {item.first};
+        const Index station {item.second};
+        if (travelTime > travelTimes[station]) continue;
+
+        // Parallel edges share a neighbor, so each is relaxed once.
+        for (const auto& neighbor : layout_->stations[station].neighbors) {
+            if (neighbor.nEdgesOut == 0) continue;
+            const unsigned int nextTravelTime {
+                travelTime + GetEdgeTravelTime(station, neighbor.station)
+            };
+            if (nextTravelTime < travelTimes[neighbor.station]) {
+                travelTimes[neighbor.station] = nextTravelTime;
+                queue.emplace(nextTravelTime, neighbor.station);
+            }
         }
     }
+}
 
-    std::sort(result.begin(), result.end());
-
-    return result;
+void TransportNetwork::ComputeTravelTimeMatrixRows(
+    const std::vector<Index>& sources,
+    unsigned int* matrix,
+    const unsigned int nThreads
+) const {
+    // Each row is independent, so the workers just pull the next source.
+    std::atomic<size_t> next {0};
+    auto worker = [this, &sources, matrix, &next]() {
+        for (size_t i = next++; i < sources.size(); i = next++) {
+            ComputeTravelTimes(
+                sources[i],
+                matrix + sources[i] * layout_->stations.size()
+            );
+        }
+    };
 
-}   
+    const size_t nWorkers {std::min<size_t>(nThreads, sources.size())};
+    if (nWorkers <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> threads {};
+    threads.reserve(nWorkers - 1);
+    for (size_t i = 1; i < nWorkers; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
 
-bool TransportNetwork::SetTravelTime(
-    const Id& stationA,
-    const Id& stationB,
-    const unsigned int travelTime
+void TransportNetwork::UpdateTravelTimeMatrix(
+    const std::vector<TravelTimeChange>& changes
 ) {
-    if (stations_.count(stationA) == 0) return false;
-    if (stations_.count(stationB) == 0) return false;
+    if (!HasTravelTimeMatrix()) return;
 
-    if (TransportNetwork::AreAdjacent(stationA, stationB)) {
-        std::string key = TransportNetwork::MakeEdgeKey(stationA, stationB);
-        travelTimes_[key] = travelTime;
-        return true;
+    // A row needs recomputing only if a changed edge, in either direction, is
+    // on one of its shortest paths (longer edge) or would shorten one (shorter
+    // edge). Checking each change against the old row is enough for a batch:
+    // if none of them passes, the old shortest paths are still the shortest.
+    const size_t nStations {layout_->stations.size()};
+    auto isAffected = [](
+        const unsigned int* row,
+        const Index from,
+        const Index to,
+        const TravelTimeChange& change
+    ) {
+        if (row[from] == kUnreachable) return false;
+        const unsigned long long viaOld {
+            static_cast<unsigned long long>(row[from]) + change.oldTravelTime
+        };
+        const unsigned long long viaNew {
+            static_cast<unsigned long long>(row[from]) + change.newTravelTime
+        };
+        if (change.newTravelTime > change.oldTravelTime) {
+            return viaOld == row[to];
+        }
+        return viaNew < row[to];
+    };
+
+    std::vector<Index> sources {};
+    for (size_t source = 0; source < nStations; ++source) {
+        const unsigned int* row {travelTimeMatrix_->data() + source * nStations};
+        for (const auto& change : changes) {
+            if (isAffected(row, change.stationA, change.stationB, change) ||
+                isAffected(row, change.stationB, change.stationA, change)) {
+                sources.push_back(static_cast<Index>(source));
+                break;
+            }
+        }
     }
-    return false;
+    if (sources.empty()) return;
+
+    auto& matrix {MakeMutable(travelTimeMatrix_)};
+    ComputeTravelTimeMatrixRows(sources, matrix.data(), travelTimeMatrixThreads_);
 }
 
-unsigned int TransportNetwork::GetTravelTime(const Id& stationA,
-     const Id& stationB
-    ) const {
-    if (stationA == stationB) return 0;
-    std::string key = TransportNetwork::MakeEdgeKey(stationA, stationB);
-    
-    auto it = travelTimes_.find(key);
-    if (it != travelTimes_.end()) {
-        return travelTimes_.at(key);
+void TransportNetwork::BuildContractionHierarchy() {
+    const size_t nStations {layout_->stations.size()};
+
+    // Parallel edges from different routes collapse into a single arc.
+    Adjacency outArcs(nStations);
+    Adjacency inArcs(nStations);
+    for (Index station = 0; station < nStations; ++station) {
+        for (const auto& edge : GetEdges(station)) {
+            const unsigned int travelTime {
+                GetEdgeTravelTime(station, edge.nextStationIndex)
+            };
+            AddArc(outArcs[station], edge.nextStationIndex, travelTime);
+            AddArc(inArcs[edge.nextStationIndex], station, travelTime);
+        }
     }
-    return 0;
+
+    HierarchyBuilder builder {std::move(outArcs), std::move(inArcs)};
+    builder.Run();
+    const auto& ranks {builder.GetRanks()};
+
+    // Upward arcs are searched forward from the source. Downward arcs are
+    // searched backward from the target, so they are stored reversed.
+    std::vector<std::vector<HierarchyEdge>> upEdges(nStations);
+    std::vector<std::vector<HierarchyEdge>> downEdges(nStations);
+    for (Index station = 0; station < nStations; ++station) {
+        for (const auto& arc : builder.GetOutArcs()[station]) {
+            if (ranks[station] < ranks[arc.station]) {
+                upEdges[station].push_back({arc.station, arc.travelTime});
+            } else {
+                downEdges[arc.station].push_back({station, arc.travelTime});
+            }
+        }
+    }
+
+    auto flatten = [](
+        const std::vector<std::vector<HierarchyEdge>>& edges,
+        std::vector<std::uint32_t>& offsets,
+        std::vector<HierarchyEdge>& flat
+    ) {
+        offsets.clear();
+        flat.clear();
+        for (const auto& stationEdges : edges) {
+            offsets.push_back(static_cast<std::uint32_t>(flat.size()));
+            flat.insert(flat.end(), stationEdges.begin(), stationEdges.end());
+        }
+        offsets.push_back(static_cast<std::uint32_t>(flat.size()));
+    };
+    auto hierarchy {std::make_shared<Hierarchy>()};
+    flatten(upEdges, hierarchy->upOffsets, hierarchy->upEdges);
+    flatten(downEdges, hierarchy->downOffsets, hierarchy->downEdges);
+    hierarchy_ = std::move(hierarchy);
 }
 
-unsigned int TransportNetwork::GetTravelTime(
-    const Id& line,
-    const Id& route,
-    const Id& stationA,
-    const Id& stationB
-) const {
-    if (lines_.count(line) == 0) return 0;
-    if (routes_.count(route) == 0) return 0;
-    if (stationA == stationB) return 0;
+bool TransportNetwork::HasContractionHierarchy() const {
+    return !layout_->stations.empty() && hierarchy_ != nullptr;
+}
+
+nlohmann::json TransportNetwork::GetContractionHierarchyJson() const {
+    nlohmann::json dst {};
+    if (!HasContractionHierarchy()) return dst;
+
+    auto edgesToJson = [](const std::vector<HierarchyEdge>& edges) {
+        std::vector<unsigned int> flat {};
+        flat.reserve(edges.size() * 2);
+        for (const auto& edge : edges) {
+            flat.push_back(edge.station);
+            flat.push_back(edge.travelTime);
+        }
+        return flat;
+    };
 
-    const Route& r = routes_.at(route);
+    // The hierarchy refers to stations by index, so record which station each
+    // index stands for.
+    std::vector<Id> stationIds {};
+    stationIds.reserve(layout_->stations.size());
+    for (const auto& node : layout_->stations) {
+        stationIds.emplace_back(node.stationId);
+    }
+
+    dst["version"] = 1;
+    dst["station_ids"] = std::move(stationIds);
+    dst["up_offsets"] = hierarchy_->upOffsets;
+    dst["up_edges"] = edgesToJson(hierarchy_->upEdges);
+    dst["down_offsets"] = hierarchy_->downOffsets;
+    dst["down_edges"] = edgesToJson(hierarchy_->downEdges);
+    return dst;
+}
 
-    int idxA = -1, idxB = -1;
+bool TransportNetwork::LoadContractionHierarchy(const nlohmann::json& src) {
+    if (src.at("version").get<int>() != 1) return false;
 
-    for (int i = 0; i < r.stops.size(); ++i) {
-        if (r.stops[i] == stationA) idxA = i;
-        if (r.stops[i] == stationB) idxB = i;
+    const auto stationIds {src.at("station_ids").get<std::vector<Id>>()};
+    if (stationIds.size() != layout_->stations.size()) return false;
+    for (size_t i = 0; i < stationIds.size(); ++i) {
+        if (stationIds[i] != layout_->stations[i].stationId) return false;
     }
 
-    if (idxA >= idxB) return 0;
+    auto load = [this](
+        const nlohmann::json& offsetsJson,
+        const nlohmann::json& edgesJson,
+        std::vector<std::uint32_t>& offsets,
+        std::vector<HierarchyEdge>& edges
+    ) {
+        offsets = offsetsJson.get<std::vector<std::uint32_t>>();
+        const auto flat {edgesJson.get<std::vector<unsigned int>>()};
+        if (offsets.size() != layout_->stations.size() + 1 || flat.size() % 2 != 0 ||
+            offsets.front() != 0 || offsets.back() != flat.size() / 2 ||
+            !std::is_sorted(offsets.begin(), offsets.end())) {
+            return false;
+        }
+        edges.clear();
+        edges.reserve(flat.size() / 2);
+        for (size_t i = 0; i < flat.size(); i += 2) {
+            if (flat[i] >= layout_->stations.size()) return false;
+            edges.push_back({flat[i], flat[i + 1]});
+        }
+        return true;
+    };
+
+    auto hierarchy {std::make_shared<Hierarchy>()};
+    bool ok {true};
+    ok &= load(
+        src.at("up_offsets"), src.at("up_edges"),
+        hierarchy->upOffsets, hierarchy->upEdges
+    );
+    ok &= load(
+        src.at("down_offsets"), src.at("down_edges"),
+        hierarchy->downOffsets, hierarchy->downEdges
+    );
+    if (!ok) return false;
+
+    hierarchy_ = std::move(hierarchy);
+    return true;
+}
 
-    int sumTime = 0;
+unsigned int TransportNetwork::QueryContractionHierarchy(
+    const Index source,
+    const Index target
+) const {
+    // Per-thread search state, reset through the touched lists so that a query
+    // never clears or reallocates the whole arrays.
+    struct Search {
+        std::vector<unsigned int> travelTimes {};
+        std::vector<Index> touched {};
+        std::vector<std::pair<unsigned int, Index>> queue {};
+    };
+    thread_local Search searches[2] {};
 
-    for (int i = idxA; i < idxB; ++i) {
-        Id cur = r.stops[i];
-        Id next = r.stops[i+1];
-        
-        sumTime += GetTravelTime(cur, next);
-        
+    const size_t nStations {layout_->stations.size()};
+    for (auto& search : searches) {
+        if (search.travelTimes.size() < nStations) {
+            search.travelTimes.resize(nStations, kUnreachable);
+        }
     }
+    const std::vector<std::uint32_t>* offsets[2] {
+        &hierarchy_->upOffsets, &hierarchy_->downOffsets
+    };
+    const std::vector<HierarchyEdge>* edges[2] {
+        &hierarchy_->upEdges, &hierarchy_->downEdges
+    };
+    const auto later = std::greater<std::pair<unsigned int, Index>>();
 
-    return sumTime;
+    const Index starts[2] {source, target};
+    for (int side = 0; side < 2; ++side) {
+        searches[side].travelTimes[starts[side]] = 0;
+        searches[side].touched.push_back(starts[side]);
+        searches[side].queue.emplace_back(0, starts[side]);
+    }
 
-    
+    // Alternate between the two searches, always advancing the one with the
+    // closest frontier, until neither frontier can improve the best meeting.
+    unsigned int best {kUnreachable};
+    while (true) {
+        int side {-1};
+        unsigned int frontier {kUnreachable};
+        for (int i = 0; i < 2; ++i) {
+            if (!searches[i].queue.empty() &&
+                searches[i].queue.front().first < frontier) {
+                side = i;
+                frontier = searches[i].queue.front().first;
+            }
+        }
+        if (side < 0 || frontier >= best) break;
+
+        Search& search {searches[side]};
+        const Search& other {searches[1 - side]};
+        std::pop_heap(search.queue.begin(), search.queue.end(), later);
+        const auto item {search.queue.back()};
+        search.queue.pop_back();
+        const unsigned int travelTime {item.first};
+        const Index station {item.second};
+        if (travelTime > search.travelTimes[station]) continue;
+
+        if (other.travelTimes[station] != kUnreachable) {
+            best = std::min(best, travelTime + other.travelTimes[station]);
+        }
+        for (auto edge {edges[side]->begin() + (*offsets[side])[station]};
+             edge != edges[side]->begin() + (*offsets[side])[station + 1];
+             ++edge) {
+            const unsigned int nextTravelTime {travelTime + edge->travelTime};
+            unsigned int& stored {search.travelTimes[edge->station]};
+            if (nextTravelTime < stored) {
+                if (stored == kUnreachable) {
+                    search.touched.push_back(edge->station);
+                }
+                stored = nextTravelTime;
+                search.queue.emplace_back(nextTravelTime, edge->station);
+                std::push_heap(search.queue.begin(), search.queue.end(), later);
+            }
+        }
+    }
+
+    for (auto& search : searches) {
+        for (const Index station : search.touched) {
+            search.travelTimes[station] = kUnreachable;
+        }
+        search.touched.clear();
+        search.queue.clear();
+    }
+    return best;
 }
 
-bool TransportNetwork::FromJson(nlohmann::json&& src ) {
+void TransportNetwork::ClearContractionHierarchy() {
+    hierarchy_.reset();
+}
+
+bool TransportNetwork::FromJson(
+    nlohmann::json&& src,
+    const unsigned int nThreads
+) {
 
     bool ok {true};
 
@@ -193,42 +2939,488 @@ bool TransportNetwork::FromJson(nlohmann::json&& src ) {
         }
     }
 
-    for (auto&& lineJson : src.at("lines")) {
-        Line line {
-            std::move(lineJson.at("line_id").get<std::string>()),
-            std::move(lineJson.at("name").get<std::string>())
-        };
-        line.routes.reserve(lineJson.at("routes").size());
-
-        for (auto&& routeJson : lineJson.at("routes")) {
-            line.routes.emplace_back(Route {
-                std::move(routeJson.at("route_id").get<std::string>()),
-                std::move(routeJson.at("direction").get<std::string>()),
-                std::move(routeJson.at("line_id").get<std::string>()),
-                std::move(routeJson.at("start_station_id").get<std::string>()),
-                std::move(routeJson.at("end_station_id").get<std::string>()),
-                std::move(routeJson.at("route_stops").get<std::vector<std::string>>())
-            });
+    const auto& linesJson {src.at("lines")};
+    const size_t nWorkers {std::min<size_t>(
+        nThreads > 0 ? nThreads : std::max(std::thread::hardware_concurrency(), 1u),
+        linesJson.size()
+    )};
+    if (nWorkers <= 1) {
+        for (auto&& lineJson : linesJson) {
+            Line line {ParseLineJson(lineJson)};
 
+            ok &= AddLine(line);
+            if (!ok) throw nlohmann::json::other_error::create(501, "Couldnt add line " + line.id, nullptr);
         }
-        
-        ok &= AddLine(line);
-        if (!ok) throw nlohmann::json::other_error::create(501, "Couldnt add line " + line.id, nullptr);
+    } else {
+        AddLinesJson(linesJson, nWorkers);
     }
 
+    Freeze();
 
-    for (auto&& travelTimeJson : src.at("travel_times")) {
-        ok &= SetTravelTime(
-            std::move(travelTimeJson.at("start_station_id").get<std::string>()),
-            std::move(travelTimeJson.at("end_station_id").get<std::string>()),
-            std::move(travelTimeJson.at("travel_time").get<unsigned int>())
-        );
+    const auto& travelTimesJson {src.at("travel_times")};
+    std::vector<TravelTime> travelTimes {};
+    travelTimes.reserve(travelTimesJson.size());
+    for (auto&& travelTimeJson : travelTimesJson) {
+        travelTimes.push_back({
+            travelTimeJson.at("start_station_id").get<std::string>(),
+            travelTimeJson.at("end_station_id").get<std::string>(),
+            travelTimeJson.at("travel_time").get<unsigned int>()
+        });
     }
+    ok &= SetTravelTimes(travelTimes).empty();
 
     return ok;
     
 }
 
+void TransportNetwork::AddLinesJson(
+    const nlohmann::json& linesJson,
+    const size_t nWorkers
+) {
+    // Stations are all in the network by now, so the workers can parse the
+    // lines and resolve their stops independently. Each worker only reads the
+    // station index and writes to its own slots.
+    struct ResolvedLine {
+        Line line {};
+        std::vector<Index> routeStops {};
+        bool resolved {false};
+        std::exception_ptr error {};
+    };
+    std::vector<const nlohmann::json*> lineJsons {};
+    lineJsons.reserve(linesJson.size());
+    for (const auto& lineJson : linesJson) {
+        lineJsons.push_back(&lineJson);
+    }
+    std::vector<ResolvedLine> resolvedLines(lineJsons.size());
+
+    std::atomic<size_t> next {0};
+    auto worker = [this, &lineJsons, &resolvedLines, &next]() {
+        for (size_t i = next++; i < resolvedLines.size(); i = next++) {
+            ResolvedLine& resolvedLine {resolvedLines[i]};
+            try {
+                resolvedLine.line = ParseLineJson(*lineJsons[i]);
+                resolvedLine.resolved = ResolveRouteStops(
+                    resolvedLine.line,
+                    resolvedLine.routeStops
+                );
+            } catch (...) {
+                resolvedLine.error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads {};
+    threads.reserve(nWorkers - 1);
+    for (size_t i = 1; i < nWorkers; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Merge in file order, stopping at the first line that fails, like the
+    // serial path does.
+    for (auto& resolvedLine : resolvedLines) {
+        if (resolvedLine.error) {
+            std::rethrow_exception(resolvedLine.error);
+        }
+        if (!resolvedLine.resolved ||
+            !AddResolvedLine(resolvedLine.line, resolvedLine.routeStops)) {
+            throw nlohmann::json::other_error::create(501, "Couldnt add line " + resolvedLine.line.id, nullptr);
+        }
+    }
+}
+
+bool TransportNetwork::FromJson(std::istream& src) {
+    LayoutSaxHandler handler {*this};
+    nlohmann::json::sax_parse(src, &handler);
+    return handler.Finish();
+}
+
+bool TransportNetwork::ApplyLayoutDiff(const nlohmann::json& src) {
+    // Parse and check the whole layout before changing anything, so that a bad
+    // layout leaves the network as it is.
+    const auto& stationsJson {src.at("stations")};
+    std::vector<Station> stations {};
+    stations.reserve(stationsJson.size());
+    std::unordered_set<std::string_view> stationIds {};
+    for (const auto& stationJson : stationsJson) {
+        stations.push_back({
+            stationJson.at("station_id").get<std::string>(),
+            stationJson.at("name").get<std::string>()
+        });
+        if (!stationIds.insert(stations.back().id).second) {
+            throw nlohmann::json::other_error::create(501, "Couldnt add station " + stations.back().id, nullptr);
+        }
+    }
+
+    const auto& linesJson {src.at("lines")};
+    std::vector<Line> lines {};
+    lines.reserve(linesJson.size());
+    std::unordered_map<std::string_view, const Line*> linesById {};
+    std::unordered_set<std::string_view> routeIds {};
+    for (const auto& lineJson : linesJson) {
+        lines.push_back(ParseLineJson(lineJson));
+        const Line& line {lines.back()};
+        bool valid {linesById.emplace(line.id, &line).second};
+        for (const Route& route : line.routes) {
+            valid &= routeIds.insert(route.id).second;
+            for (const Id& stop : route.stops) {
+                valid &= stationIds.count(stop) > 0;
+            }
+        }
+        if (!valid) {
+            throw nlohmann::json::other_error::create(501, "Couldnt add line " + line.id, nullptr);
+        }
+    }
+
+    std::vector<TravelTime> travelTimes {};
+    travelTimes.reserve(src.at("travel_times").size());
+    for (const auto& travelTimeJson : src.at("travel_times")) {
+        travelTimes.push_back({
+            travelTimeJson.at("start_station_id").get<std::string>(),
+            travelTimeJson.at("end_station_id").get<std::string>(),
+            travelTimeJson.at("travel_time").get<unsigned int>()
+        });
+    }
+
+    const bool wasFrozen {layout_->frozen};
+
+    // Lines that are gone or whose routes changed go first, so that the
+    // stations they serve can be removed and their route IDs reused. Removing
+    // a line may copy a shared layout, so the loops index layout_ afresh.
+    for (Index line = 0; line < layout_->lines.size(); ++line) {
+        const LineNode& lineNode {layout_->lines[line]};
+        if (lineNode.removed) continue;
+
+        auto it {linesById.find(lineNode.id)};
+        if (it == linesById.end() || !IsSameLine(lineNode, *it->second)) {
+            RemoveLineAt(line);
+        } else if (lineNode.name != it->second->name) {
+            Layout& layout {MutableLayout()};
+            layout.lines[line].name = Intern(it->second->name);
+            ++layout.nTombstones;
+        }
+    }
+
+    for (Index station = 0; station < layout_->stations.size(); ++station) {
+        const GraphNode& node {layout_->stations[station]};
+        if (!node.removed && stationIds.count(node.stationId) == 0) {
+            RemoveStationAt(station);
+        }
+    }
+    for (const Station& station : stations) {
+        const Index stationIndex {GetStationIndex(station.id)};
+        if (stationIndex == kInvalidIndex) {
+            AddStation(station);
+        } else if (layout_->stations[stationIndex].name != station.name) {
+            Layout& layout {MutableLayout()};
+            layout.stations[stationIndex].name = Intern(station.name);
+            ++layout.nTombstones;
+        }
+    }
+
+    // Every stop is known and every ID is free by now, so adding the lines
+    // cannot fail.
+    for (const Line& line : lines) {
+        if (layout_->lineIndices.count(line.id) == 0) {
+            AddLine(line);
+        }
+    }
+    if (wasFrozen) {
+        Freeze();
+    }
+
+    // Travel times are compared by station pair. Pairs that are missing from
+    // the new layout, or no longer adjacent, are cleared. SetTravelTimes then
+    // only changes the travel times that differ.
+    std::unordered_set<EdgeKey, EdgeKeyHash> newKeys {};
+    newKeys.reserve(travelTimes.size());
+    for (const auto& item : travelTimes) {
+        const Index stationA {GetStationIndex(item.startStationId)};
+        const Index stationB {GetStationIndex(item.endStationId)};
+        if (stationA != kInvalidIndex && stationB != kInvalidIndex &&
+            AreAdjacent(stationA, stationB)) {
+            newKeys.insert(MakeEdgeKey(stationA, stationB));
+        }
+    }
+
+    std::vector<EdgeKey> clearedKeys {};
+    for (const auto& travelTime : travelTimes_) {
+        if (newKeys.count(travelTime.first) == 0) {
+            clearedKeys.push_back(travelTime.first);
+        }
+    }
+    for (const EdgeKey key : clearedKeys) {
+        const auto stationA {static_cast<Index>(key >> 32)};
+        const auto stationB {static_cast<Index>(key)};
+        if (AreAdjacent(stationA, stationB)) {
+            SetEdgeTravelTime(stationA, stationB, 0);
+        }
+        travelTimes_.erase(key);
+    }
+
+    return SetTravelTimes(travelTimes).empty();
+}
+
+bool TransportNetwork::SaveSnapshot(
+    const std::filesystem::path& destination
+) const {
+    // Tombstones are not saved, so a network with removed stations, lines, or
+    // routes saves a compacted copy of itself.
+    if (layout_->nTombstones > 0) {
+        TransportNetwork compacted {*this};
+        compacted.Compact();
+        return compacted.SaveSnapshot(destination);
+    }
+
+    SnapshotWriter writer {};
+
+    writer.Write(static_cast<std::uint32_t>(layout_->stations.size()));
+    for (const auto& node : layout_->stations) {
+        writer.WriteString(node.stationId);
+        writer.WriteString(node.name);
+    }
+
+    writer.Write(static_cast<std::uint32_t>(layout_->lines.size()));
+    for (const auto& line : layout_->lines) {
+        writer.WriteString(line.id);
+        writer.WriteString(line.name);
+    }
+
+    writer.Write(static_cast<std::uint32_t>(layout_->routes.size()));
+    for (const auto& routeNode : layout_->routes) {
+        writer.WriteString(routeNode.id);
+        writer.WriteString(routeNode.direction);
+        writer.Write(routeNode.lineIndex);
+        writer.Write(routeNode.stopCount);
+        for (Index j = 0; j < routeNode.stopCount; ++j) {
+            writer.Write(layout_->routeStops[routeNode.stopOffset + j]);
+        }
+    }
+
+    for (const auto& node : layout_->stations) {
+        writer.Write(static_cast<std::uint32_t>(node.routes.size()));
+        for (const Index route : node.routes) {
+            writer.Write(route);
+        }
+    }
+
+    // CSR edges, whether or not the network is currently frozen.
+    std::uint32_t nEdges {0};
+    writer.Write(nEdges);
+    for (Index station = 0; station < layout_->stations.size(); ++station) {
+        const EdgeRange edges {GetEdges(station)};
+        nEdges += static_cast<std::uint32_t>(edges.end() - edges.begin());
+        writer.Write(nEdges);
+    }
+    for (Index station = 0; station < layout_->stations.size(); ++station) {
+        for (const auto& edge : GetEdges(station)) {
+            writer.Write(edge.lineIndex);
+            writer.Write(edge.routeIndex);
+            writer.Write(edge.nextStationIndex);
+        }
+    }
+
+    // Sorted, so that the same network always gives the same snapshot.
+    std::vector<std::pair<EdgeKey, unsigned int>> travelTimes {
+        travelTimes_.begin(), travelTimes_.end()
+    };
+    std::sort(travelTimes.begin(), travelTimes.end());
+    writer.Write(static_cast<std::uint32_t>(travelTimes.size()));
+    for (const auto& travelTime : travelTimes) {
+        writer.Write(travelTime.first);
+        writer.Write(static_cast<std::uint32_t>(travelTime.second));
+    }
+
+    const std::vector<char> payload {writer.GetPayload()};
+    SnapshotHeader header {};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.byteOrder = kSnapshotByteOrder;
+    header.version = kSnapshotVersion;
+    header.payloadSize = payload.size();
+    header.checksum = SnapshotChecksum(payload.data(), payload.size());
+
+    std::ofstream file {destination, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    file.close();
+    return !file.fail();
+}
+
+bool TransportNetwork::LoadSnapshot(const std::filesystem::path& source) {
+    namespace bip = boost::interprocess;
+
+    bip::mapped_region region {};
+    try {
+        bip::file_mapping file {source.c_str(), bip::read_only};
+        bip::mapped_region mapped {file, bip::read_only};
+        region.swap(mapped);
+    } catch (const bip::interprocess_exception&) {
+        return false;
+    }
+    const char* data {static_cast<const char*>(region.get_address())};
+    const size_t size {region.get_size()};
+
+    SnapshotHeader header {};
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 ||
+        header.byteOrder != kSnapshotByteOrder ||
+        header.version != kSnapshotVersion ||
+        header.payloadSize != size - sizeof(header)) {
+        return false;
+    }
+    const char* payload {data + sizeof(header)};
+    if (SnapshotChecksum(payload, size - sizeof(header)) != header.checksum) {
+        return false;
+    }
+
+    // Load into a new network, so that a bad snapshot leaves this one as is.
+    SnapshotReader reader {payload, size - sizeof(header)};
+    TransportNetwork network {};
+    Layout& layout {network.MutableLayout()};
+
+    const auto nStations {reader.Read<std::uint32_t>()};
+    if (!reader.CanRead(nStations, 4 * sizeof(std::uint32_t))) return false;
+    layout.stations.resize(nStations);
+    layout.stationIndices.reserve(nStations);
+    for (Index station = 0; station < nStations; ++station) {
+        GraphNode& node {layout.stations[station]};
+        node.stationId = network.Intern(reader.ReadString());
+        node.name = network.Intern(reader.ReadString());
+        if (!layout.stationIndices.emplace(node.stationId, station).second) {
+            return false;
+        }
+    }
+
+    const auto nLines {reader.Read<std::uint32_t>()};
+    if (!reader.CanRead(nLines, 4 * sizeof(std::uint32_t))) return false;
+    layout.lines.resize(nLines);
+    layout.lineIndices.reserve(nLines);
+    for (Index line = 0; line < nLines; ++line) {
+        layout.lines[line].id = network.Intern(reader.ReadString());
+        layout.lines[line].name = network.Intern(reader.ReadString());
+        if (!layout.lineIndices.emplace(layout.lines[line].id, line).second) {
+            return false;
+        }
+    }
+
+    const auto nRoutes {reader.Read<std::uint32_t>()};
+    if (!reader.CanRead(nRoutes, 6 * sizeof(std::uint32_t))) return false;
+    layout.routes.resize(nRoutes);
+    layout.routeIndices.reserve(nRoutes);
+    for (Index route = 0; route < nRoutes; ++route) {
+        RouteNode& routeNode {layout.routes[route]};
+        routeNode.id = network.Intern(reader.ReadString());
+        routeNode.direction = network.Intern(reader.ReadString());
+        routeNode.lineIndex = reader.Read<Index>();
+        const auto nStops {reader.Read<std::uint32_t>()};
+        if (!reader.CanRead(nStops, sizeof(Index)) ||
+            routeNode.lineIndex >= nLines || nStops == 0 ||
+            !layout.routeIndices.emplace(routeNode.id, route).second) {
+            return false;
+        }
+
+        routeNode.stopOffset = static_cast<Index>(layout.routeStops.size());
+        routeNode.stopCount = nStops;
+        for (Index j = 0; j < nStops; ++j) {
+            const auto station {reader.Read<Index>()};
+            if (station >= nStations) return false;
+            layout.routeStops.push_back(station);
+        }
+
+        // The routes of a line must be consecutive.
+        LineNode& lineNode {layout.lines[routeNode.lineIndex]};
+        if (lineNode.routeCount == 0) {
+            lineNode.firstRoute = route;
+        } else if (lineNode.firstRoute + lineNode.routeCount != route) {
+            return false;
+        }
+        ++lineNode.routeCount;
+    }
+
+    for (auto& node : layout.stations) {
+        const auto nServing {reader.Read<std::uint32_t>()};
+        if (!reader.CanRead(nServing, sizeof(Index))) return false;
+        node.routes.resize(nServing);
+        for (auto& route : node.routes) {
+            route = reader.Read<Index>();
+            if (route >= nRoutes) return false;
+        }
+    }
+
+    if (!reader.CanRead(nStations + 1, sizeof(std::uint32_t))) return false;
+    layout.edgeOffsets.resize(nStations + 1);
+    for (auto& offset : layout.edgeOffsets) {
+        offset = reader.Read<std::uint32_t>();
+    }
+    if (layout.edgeOffsets.front() != 0 ||
+        !std::is_sorted(layout.edgeOffsets.begin(), layout.edgeOffsets.end())) {
+        return false;
+    }
+    layout.edgeEnds.assign(layout.edgeOffsets.begin() + 1, layout.edgeOffsets.end());
+    const std::uint32_t nEdges {layout.edgeOffsets.back()};
+    if (!reader.CanRead(nEdges, 3 * sizeof(Index))) return false;
+    layout.edges.resize(nEdges);
+    for (auto& edge : layout.edges) {
+        edge.lineIndex = reader.Read<Index>();
+        edge.routeIndex = reader.Read<Index>();
+        edge.nextStationIndex = reader.Read<Index>();
+        if (edge.lineIndex >= nLines || edge.routeIndex >= nRoutes ||
+            edge.nextStationIndex >= nStations) {
+            return false;
+        }
+    }
+    layout.frozen = true;
+    for (Index station = 0; station < nStations; ++station) {
+        for (const auto& edge : network.GetEdges(station)) {
+            network.LinkStations(station, edge.nextStationIndex);
+        }
+    }
+
+    const auto nTravelTimes {reader.Read<std::uint32_t>()};
+    if (!reader.CanRead(nTravelTimes, sizeof(EdgeKey) + sizeof(std::uint32_t))) {
+        return false;
+    }
+    network.travelTimes_.reserve(nTravelTimes);
+    for (std::uint32_t i = 0; i < nTravelTimes; ++i) {
+        const auto key {reader.Read<EdgeKey>()};
+        const auto travelTime {reader.Read<std::uint32_t>()};
+        const auto stationA {static_cast<Index>(key >> 32)};
+        const auto stationB {static_cast<Index>(key)};
+        if (stationA >= stationB || stationB >= nStations) return false;
+        network.travelTimes_[key] = travelTime;
+    }
+    if (!reader.IsAtEnd()) return false;
+
+    network.cumulativeTimes_.reserve(layout.routeStops.size());
+    layout.stopPositions.reserve(layout.routeStops.size());
+    for (const auto& routeNode : layout.routes) {
+        network.IndexRouteStops(routeNode);
+    }
+
+    network.passengerCounts_.resize(nStations);
+    network.SetPassengerFlowHistory(flowBucketWidth_, flowBucketCount_);
+    network.crowdingThresholds_ = crowdingThresholds_;
+    network.crowdingCost_ = crowdingCost_;
+
+    *this = std::move(network);
+    return true;
+}
+
+TransportNetworkSnapshot TransportNetwork::TakeSnapshot() const {
+    // The copy constructor shares the layout, the travel time matrix, and the
+    // contraction hierarchy.
+    return std::make_shared<const TransportNetwork>(*this);
+}
+
+void SnapshotPublisher::Publish(TransportNetworkSnapshot snapshot) {
+    std::atomic_store(&latest_, std::move(snapshot));
+}
 
+TransportNetworkSnapshot SnapshotPublisher::GetLatest() const {
+    return std::atomic_load(&latest_);
+}
 
-}
\ No newline at end of file
+}
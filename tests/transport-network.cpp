@@ -4,18 +4,57 @@
 #include <boost/test/unit_test.hpp>
 #include <nlohmann/json.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <new>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 using NetworkMonitor::Id;
 using NetworkMonitor::Line;
 using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerFlow;
 using NetworkMonitor::Route;
 using NetworkMonitor::Station;
 using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::SnapshotPublisher;
 using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TransportNetworkSnapshot;
+using NetworkMonitor::TravelRoute;
+
+// Heap allocations made by the test module, so that tests can count the
+// allocations made by a single operation.
+static std::atomic<size_t> gAllocations {0};
+static std::atomic<size_t> gAllocatedBytes {0};
+
+void* operator new(std::size_t size)
+{
+    ++gAllocations;
+    gAllocatedBytes += size;
+    if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
 
 BOOST_AUTO_TEST_SUITE(network_monitor);
 
@@ -209,6 +248,101 @@ BOOST_AUTO_TEST_CASE(duplicate)
     BOOST_CHECK(!ok);
 }
 
+BOOST_AUTO_TEST_CASE(missing_stations)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // A line with a route through a missing station is rejected as a whole.
+    // route0: 0 ---> 1
+    // route1: 1 ---> 2 (station 2 is not in the network)
+    Station station0 {
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1 {
+        "station_001",
+        "Station Name 1",
+    };
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_001",
+        "station_002",
+        {"station_001", "station_002"},
+    };
+    Line line {
+        "line_000",
+        "Line Name",
+        {route0, route1},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    BOOST_REQUIRE(ok);
+    ok = nw.AddLine(line);
+    BOOST_CHECK(!ok);
+
+    // The valid route was not partially added.
+    BOOST_CHECK_EQUAL(nw.GetRoutesServingStation(station0.id).size(), 0);
+    BOOST_CHECK(!nw.SetTravelTime(station0.id, station1.id, 1));
+}
+
+BOOST_AUTO_TEST_CASE(names)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    Station station0 {
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1 {
+        "station_001",
+        "Station Name 1",
+    };
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    Line line {
+        "line_000",
+        "Line Name",
+        {route0},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddLine(line);
+    BOOST_REQUIRE(ok);
+
+    // The network keeps its own copy of the strings.
+    station0.name.clear();
+    line.name.clear();
+    line.routes[0].direction.clear();
+    BOOST_CHECK_EQUAL(nw.GetStationName("station_000"), "Station Name 0");
+    BOOST_CHECK_EQUAL(nw.GetLineName("line_000"), "Line Name");
+    BOOST_CHECK_EQUAL(nw.GetRouteDirection("route_000"), "inbound");
+
+    // Unknown IDs.
+    BOOST_CHECK(nw.GetStationName("station_002").empty());
+    BOOST_CHECK(nw.GetLineName("line_001").empty());
+    BOOST_CHECK(nw.GetRouteDirection("route_001").empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END(); // AddLine
 
 BOOST_AUTO_TEST_SUITE(PassengerEvents);
@@ -287,6 +421,254 @@ BOOST_AUTO_TEST_CASE(basic)
     BOOST_CHECK_EQUAL(nw.GetPassengerCount(station2.id), -1);
 }
 
+BOOST_AUTO_TEST_CASE(batch)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    using EventType = PassengerEvent::Type;
+    std::vector<PassengerEvent> events {
+        {"station_000", EventType::In},
+        {"station_000", EventType::In},
+        {"station_001", EventType::Out},
+        {"station_42", EventType::In}, // Not in the network
+        {"station_000", EventType::Out},
+        {"station_001", EventType::Out},
+        {"station_002", EventType::In},
+        {"station_002", EventType::Out},
+        {"station_001", EventType::In},
+    };
+    auto rejected {nw.RecordPassengerEvents(events)};
+    BOOST_REQUIRE_EQUAL(rejected.size(), 1);
+    BOOST_CHECK_EQUAL(rejected[0], 3);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_000"), 1);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_001"), -1);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_002"), 0);
+
+    // Batches add up with single events.
+    ok = nw.RecordPassengerEvent({"station_000", EventType::In});
+    BOOST_REQUIRE(ok);
+    rejected = nw.RecordPassengerEvents(events);
+    BOOST_CHECK_EQUAL(rejected.size(), 1);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_000"), 3);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_001"), -2);
+    BOOST_CHECK(nw.RecordPassengerEvents({}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(aggregates)
+{
+    TransportNetwork nw {};
+    const nlohmann::json layout = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+    auto ok {nw.FromJson(nlohmann::json(layout))};
+    BOOST_REQUIRE(ok);
+
+    // Station i gets i % 13 passengers.
+    std::map<Id, long long int> counts {};
+    std::vector<PassengerEvent> events {};
+    for (size_t i = 0; i < layout["stations"].size(); ++i) {
+        const Id id {layout["stations"][i]["station_id"].get<Id>()};
+        counts[id] = static_cast<long long int>(i % 13);
+        for (size_t j = 0; j < i % 13; ++j) {
+            events.push_back({id, PassengerEvent::Type::In});
+        }
+    }
+    BOOST_REQUIRE(nw.RecordPassengerEvents(events).empty());
+
+    // Line and route totals count each station once.
+    for (const auto& line : layout["lines"]) {
+        std::set<Id> lineStations {};
+        for (const auto& route : line["routes"]) {
+            long long int routeTotal {0};
+            for (const auto& stop : route["route_stops"]) {
+                routeTotal += counts[stop.get<Id>()];
+                lineStations.insert(stop.get<Id>());
+            }
+            BOOST_CHECK_EQUAL(
+                nw.GetRoutePassengerCount(route["route_id"].get<Id>()),
+                routeTotal
+            );
+        }
+        long long int lineTotal {0};
+        for (const auto& station : lineStations) {
+            lineTotal += counts[station];
+        }
+        BOOST_CHECK_EQUAL(
+            nw.GetLinePassengerCount(line["line_id"].get<Id>()),
+            lineTotal
+        );
+    }
+    BOOST_CHECK_THROW(nw.GetLinePassengerCount("line_42"), std::runtime_error);
+    BOOST_CHECK_THROW(nw.GetRoutePassengerCount("route_42"), std::runtime_error);
+
+    // The most crowded stations come first, ties in the order they were
+    // added.
+    auto crowded {nw.GetMostCrowdedStations(5)};
+    BOOST_REQUIRE_EQUAL(crowded.size(), 5);
+    for (size_t i = 0; i < crowded.size(); ++i) {
+        BOOST_CHECK_EQUAL(crowded[i].passengerCount, 12);
+        BOOST_CHECK_EQUAL(crowded[i].passengerCount, counts[crowded[i].stationId]);
+        if (i > 0) {
+            BOOST_CHECK_LT(crowded[i - 1].stationId, crowded[i].stationId);
+        }
+    }
+    BOOST_CHECK_EQUAL(
+        nw.GetMostCrowdedStations(1000).size(),
+        layout["stations"].size()
+    );
+    BOOST_CHECK(nw.GetMostCrowdedStations(0).empty());
+
+    // The export is aligned with the station IDs.
+    const auto ids {nw.GetStationIds()};
+    BOOST_REQUIRE_EQUAL(ids.size(), layout["stations"].size());
+    std::vector<long long int> exported(ids.size() + 1, -1);
+    const auto start {std::chrono::steady_clock::now()};
+    const size_t nStations {nw.ExportPassengerCounts(exported.data(), exported.size())};
+    const auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "ExportPassengerCounts (" << nStations << " stations): " <<
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() <<
+        " ns"
+    );
+    BOOST_REQUIRE_EQUAL(nStations, ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        BOOST_CHECK_EQUAL(exported[i], counts[Id {ids[i]}]);
+    }
+    BOOST_CHECK_EQUAL(exported.back(), -1);
+
+    // Short buffers only get the first stations.
+    std::vector<long long int> partial(3, -1);
+    BOOST_CHECK_EQUAL(nw.ExportPassengerCounts(partial.data(), 3), ids.size());
+    BOOST_CHECK_EQUAL(partial[2], counts[Id {ids[2]}]);
+
+    // Removed stations are left out.
+    nlohmann::json diff {};
+    diff["stations"] = nlohmann::json::array({layout["stations"][0]});
+    diff["lines"] = nlohmann::json::array();
+    diff["travel_times"] = nlohmann::json::array();
+    ok = nw.ApplyLayoutDiff(diff);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(nw.GetMostCrowdedStations(1000).size(), 1);
+    BOOST_CHECK_EQUAL(nw.GetStationIds()[1], "");
+    nw.ExportPassengerCounts(exported.data(), exported.size());
+    BOOST_CHECK_EQUAL(exported[1], 0);
+}
+
+BOOST_AUTO_TEST_CASE(flow_history)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    using EventType = PassengerEvent::Type;
+    using std::chrono::minutes;
+    using std::chrono::seconds;
+    const Id station {"station_000"};
+    const std::chrono::system_clock::time_point base {std::chrono::hours(500000)};
+
+    // Disabled by default.
+    ok = nw.RecordPassengerEvent({station, EventType::In, base});
+    BOOST_REQUIRE(ok);
+    PassengerFlow flow {nw.GetPassengerFlow(station, minutes(5), base)};
+    BOOST_CHECK_EQUAL(flow.in, 0);
+
+    // 10 buckets of 1 minute each.
+    nw.SetPassengerFlowHistory(minutes(1), 10);
+    std::vector<PassengerEvent> events {
+        {station, EventType::In, base + seconds(10)},
+        {station, EventType::In, base + seconds(10)},
+        {station, EventType::In, base + seconds(10)},
+        {station, EventType::Out, base + seconds(70)},
+        {station, EventType::In, base + seconds(130)},
+    };
+    BOOST_REQUIRE(nw.RecordPassengerEvents(events).empty());
+    ok = nw.RecordPassengerEvent({station, EventType::In, base + seconds(140)});
+    BOOST_REQUIRE(ok);
+
+    const auto now {base + seconds(150)};
+    flow = nw.GetPassengerFlow(station, minutes(1), now);
+    BOOST_CHECK_EQUAL(flow.in, 2);
+    BOOST_CHECK_EQUAL(flow.out, 0);
+    flow = nw.GetPassengerFlow(station, minutes(2), now);
+    BOOST_CHECK_EQUAL(flow.in, 2);
+    BOOST_CHECK_EQUAL(flow.out, 1);
+    flow = nw.GetPassengerFlow(station, minutes(3), now);
+    BOOST_CHECK_EQUAL(flow.in, 5);
+    BOOST_CHECK_EQUAL(flow.out, 1);
+    BOOST_CHECK_EQUAL(nw.GetPassengerFlow("station_001", minutes(3), now).in, 0);
+
+    // Late events still land in their bucket.
+    ok = nw.RecordPassengerEvent({station, EventType::In, base + seconds(75)});
+    BOOST_REQUIRE(ok);
+    flow = nw.GetPassengerFlow(station, minutes(2), now);
+    BOOST_CHECK_EQUAL(flow.in, 3);
+    BOOST_CHECK_EQUAL(flow.out, 1);
+
+    // The history only covers the last 10 buckets.
+    const auto later {base + minutes(20) + seconds(5)};
+    ok = nw.RecordPassengerEvent({station, EventType::In, later});
+    BOOST_REQUIRE(ok);
+    flow = nw.GetPassengerFlow(station, std::chrono::hours(1), later);
+    BOOST_CHECK_EQUAL(flow.in, 1);
+    BOOST_CHECK_EQUAL(flow.out, 0);
+    ok = nw.RecordPassengerEvent({station, EventType::Out, base});
+    BOOST_REQUIRE(ok);
+    flow = nw.GetPassengerFlow(station, std::chrono::hours(1), later);
+    BOOST_CHECK_EQUAL(flow.out, 0);
+
+    // The running count is not affected by the history.
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount(station), 1 + 4 - 1 + 1 + 1 + 1 - 1);
+    BOOST_CHECK_THROW(
+        nw.GetPassengerFlow("station_42", minutes(1), now),
+        std::runtime_error
+    );
+}
+
+BOOST_AUTO_TEST_CASE(concurrent)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    // Several writers record events on the same stations while a reader polls
+    // the counts.
+    using EventType = PassengerEvent::Type;
+    const std::vector<Id> stations {"station_000", "station_001", "station_002"};
+    const int nThreads {4};
+    const int nEvents {10000};
+    std::atomic<bool> done {false};
+    std::thread reader {[&nw, &stations, &done]() {
+        while (!done) {
+            for (const auto& station : stations) {
+                nw.GetPassengerCount(station);
+            }
+        }
+    }};
+    std::vector<std::thread> writers {};
+    for (int i = 0; i < nThreads; ++i) {
+        writers.emplace_back([&nw, &stations, nEvents]() {
+            for (int j = 0; j < nEvents; ++j) {
+                nw.RecordPassengerEvent({stations[j % 3], EventType::In});
+                nw.RecordPassengerEvent({stations[(j + 1) % 3], EventType::Out});
+                nw.RecordPassengerEvent({stations[j % 3], EventType::In});
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    reader.join();
+
+    long long int total {0};
+    for (const auto& station : stations) {
+        total += nw.GetPassengerCount(station);
+    }
+    BOOST_CHECK_EQUAL(total, nThreads * nEvents);
+    // station_000: 2 * 3334 In events and 3333 Out events per thread.
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_000"), 3335 * nThreads);
+}
+
 BOOST_AUTO_TEST_SUITE_END(); // PassengerEvents
 
 BOOST_AUTO_TEST_SUITE(GetRoutesServingStation);
@@ -352,6 +734,85 @@ BOOST_AUTO_TEST_CASE(basic)
     BOOST_CHECK_EQUAL(routes.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(sorted_across_lines)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // Lines are added in reverse route ID order.
+    // line1/route2: 0 ---> 1
+    // line0/route0: 1 ---> 2
+    // line0/route1: 2 ---> 1
+    Station station0 {
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1 {
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2 {
+        "station_002",
+        "Station Name 2",
+    };
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_001",
+        "station_002",
+        {"station_001", "station_002"},
+    };
+    Route route1 {
+        "route_001",
+        "outbound",
+        "line_000",
+        "station_002",
+        "station_001",
+        {"station_002", "station_001"},
+    };
+    Route route2 {
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_001",
+        {"station_000", "station_001"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route1, route0},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.AddLine(line1);
+    ok &= nw.AddLine(line0);
+    BOOST_REQUIRE(ok);
+
+    BOOST_CHECK(
+        nw.GetRoutesServingStation(station1.id) ==
+        std::vector<Id>({"route_000", "route_001", "route_002"})
+    );
+    BOOST_CHECK(
+        nw.GetRoutesServingStation(station2.id) ==
+        std::vector<Id>({"route_000", "route_001"})
+    );
+    BOOST_CHECK(
+        nw.GetRoutesServingStation(station0.id) ==
+        std::vector<Id>({"route_002"})
+    );
+}
+
 BOOST_AUTO_TEST_SUITE_END(); // GetRoutesServingStation
 
 BOOST_AUTO_TEST_SUITE(TravelTime);
@@ -418,6 +879,56 @@ BOOST_AUTO_TEST_CASE(basic)
     BOOST_CHECK_EQUAL(nw.GetTravelTime(station1.id, station0.id), 3);
 }
 
+BOOST_AUTO_TEST_CASE(underscore_ids)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // Two distinct edges whose IDs concatenate to the same "a_b_c" string.
+    // route0: a ---> b_c
+    // route1: a_b ---> c
+    Station stationA {"a", "Station A"};
+    Station stationAB {"a_b", "Station A_B"};
+    Station stationBC {"b_c", "Station B_C"};
+    Station stationC {"c", "Station C"};
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "a",
+        "b_c",
+        {"a", "b_c"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "a_b",
+        "c",
+        {"a_b", "c"},
+    };
+    Line line {
+        "line_000",
+        "Line Name",
+        {route0, route1},
+    };
+    ok = true;
+    ok &= nw.AddStation(stationA);
+    ok &= nw.AddStation(stationAB);
+    ok &= nw.AddStation(stationBC);
+    ok &= nw.AddStation(stationC);
+    BOOST_REQUIRE(ok);
+    ok = nw.AddLine(line);
+    BOOST_REQUIRE(ok);
+
+    ok = true;
+    ok &= nw.SetTravelTime(stationA.id, stationBC.id, 1);
+    ok &= nw.SetTravelTime(stationAB.id, stationC.id, 2);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime(stationA.id, stationBC.id), 1);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime(stationAB.id, stationC.id), 2);
+}
+
 BOOST_AUTO_TEST_CASE(over_route)
 {
     TransportNetwork nw {};
@@ -532,42 +1043,1281 @@ BOOST_AUTO_TEST_CASE(over_route)
     );
 }
 
-BOOST_AUTO_TEST_SUITE_END(); // TravelTime
-
-BOOST_AUTO_TEST_SUITE(FromJson);
-
-std::vector<Id> GetSortedIds(std::vector<Id>& routes) {
-    std::vector<Id> ids {routes};
-    std::sort(ids.begin(), ids.end());
-    return ids;
-}
-
-BOOST_AUTO_TEST_CASE(from_json_1line_1route) {
-    auto testFilePath {
-        std::filesystem::path(TEST_DATA) / "from_json_1line_1route.json"
-    };
-
-    auto src = ParseJsonFile(testFilePath);
-
+BOOST_AUTO_TEST_CASE(over_route_updates)
+{
     TransportNetwork nw {};
+    bool ok {false};
 
-    auto ok {nw.FromJson(std::move(src))};
-    BOOST_REQUIRE(ok);
-
-    auto routes {nw.GetRoutesServingStation("station_0")};
-    BOOST_REQUIRE_EQUAL(routes.size(), 1);
-    BOOST_CHECK_EQUAL(routes[0], "route_0");
-}
-
-BOOST_AUTO_TEST_CASE(from_json_1line_2routes) {
-    auto testFilePath {
-        std::filesystem::path(TEST_DATA) / "from_json_1line_2routes.json"
+    // line0/route0: 0 ---> 1 ---> 2
+    // line1/route1: 2 ---> 1 (added after the travel times are set)
+    Station station0 {
+        "station_000",
+        "Station Name 0",
     };
+    Station station1 {
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2 {
+        "station_002",
+        "Station Name 2",
+    };
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0},
+    };
+    Route route1 {
+        "route_001",
+        "outbound",
+        "line_001",
+        "station_002",
+        "station_001",
+        {"station_002", "station_001"},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route1},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    BOOST_REQUIRE(ok);
+    ok = nw.AddLine(line0);
+    BOOST_REQUIRE(ok);
+
+    ok = true;
+    ok &= nw.SetTravelTime(station0.id, station1.id, 5);
+    ok &= nw.SetTravelTime(station1.id, station2.id, 7);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line0.id, route0.id, station0.id, station2.id), 5 + 7
+    );
+
+    // A new route picks up the travel times already set.
+    ok = nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line1.id, route1.id, station2.id, station1.id), 7
+    );
+
+    // Updating an edge, up or down, is reflected on every route using it.
+    ok = nw.SetTravelTime(station2.id, station1.id, 3);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line0.id, route0.id, station0.id, station2.id), 5 + 3
+    );
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line0.id, route0.id, station1.id, station2.id), 3
+    );
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line1.id, route1.id, station2.id, station1.id), 3
+    );
+    ok = nw.SetTravelTime(station0.id, station1.id, 9);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line0.id, route0.id, station0.id, station2.id), 9 + 3
+    );
+
+    // Stations not on the route.
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line1.id, route1.id, station2.id, station0.id), 0
+    );
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line1.id, route1.id, "station_42", station1.id), 0
+    );
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+
+    const auto& travelTimesJson {src.at("travel_times")};
+    std::vector<std::pair<Id, Id>> edges {};
+    for (const auto& travelTimeJson : travelTimesJson) {
+        edges.emplace_back(
+            travelTimeJson.at("start_station_id").get<Id>(),
+            travelTimeJson.at("end_station_id").get<Id>()
+        );
+    }
+
+    auto start {std::chrono::steady_clock::now()};
+    for (size_t i = 0; i < edges.size(); ++i) {
+        ok &= nw.SetTravelTime(edges[i].first, edges[i].second, i % 7 + 1);
+    }
+    auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_REQUIRE(ok);
+    BOOST_TEST_MESSAGE(
+        "SetTravelTime for the " << edges.size() << " edges of the full " <<
+        "layout: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            elapsed
+        ).count() << " us"
+    );
+
+    // The layout lists some edges in both directions: the last one wins.
+    std::map<std::pair<Id, Id>, unsigned int> expected {};
+    for (size_t i = 0; i < edges.size(); ++i) {
+        expected[std::minmax(edges[i].first, edges[i].second)] = i % 7 + 1;
+    }
+    for (const auto& edge : edges) {
+        BOOST_CHECK_EQUAL(
+            nw.GetTravelTime(edge.second, edge.first),
+            expected[std::minmax(edge.first, edge.second)]
+        );
+    }
+    BOOST_CHECK(!nw.SetTravelTime(edges[0].first, edges[0].first, 1));
+
+    // The same table, set as a batch, with and without a travel time matrix.
+    std::vector<NetworkMonitor::TravelTime> travelTimes {};
+    for (size_t i = 0; i < edges.size(); ++i) {
+        travelTimes.push_back({
+            edges[i].first,
+            edges[i].second,
+            static_cast<unsigned int>(i % 7 + 1)
+        });
+    }
+    TransportNetwork batch {};
+    ok = batch.FromJson(nlohmann::json(src));
+    BOOST_REQUIRE(ok);
+    start = std::chrono::steady_clock::now();
+    auto rejected {batch.SetTravelTimes(travelTimes)};
+    elapsed = std::chrono::steady_clock::now() - start;
+    BOOST_CHECK(rejected.empty());
+
+    TransportNetwork withMatrix {};
+    ok = withMatrix.FromJson(nlohmann::json(src));
+    BOOST_REQUIRE(ok);
+    withMatrix.BuildTravelTimeMatrix();
+    start = std::chrono::steady_clock::now();
+    rejected = withMatrix.SetTravelTimes(travelTimes);
+    auto matrixElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_CHECK(rejected.empty());
+    BOOST_TEST_MESSAGE(
+        "SetTravelTimes for the same edges: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            elapsed
+        ).count() << " us, " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            matrixElapsed
+        ).count() << " us with a travel time matrix"
+    );
+
+    for (const auto& stationJson : src.at("stations")) {
+        const auto station {stationJson.at("station_id").get<Id>()};
+        BOOST_CHECK_EQUAL(
+            withMatrix.GetFastestTravelTime(edges[0].first, station),
+            nw.GetFastestTravelTime(edges[0].first, station)
+        );
+    }
+    for (const auto& lineJson : src.at("lines")) {
+        const auto line {lineJson.at("line_id").get<Id>()};
+        for (const auto& routeJson : lineJson.at("routes")) {
+            const auto stops {routeJson.at("route_stops").get<std::vector<Id>>()};
+            const auto route {routeJson.at("route_id").get<Id>()};
+            BOOST_CHECK_EQUAL(
+                batch.GetTravelTime(line, route, stops.front(), stops.back()),
+                nw.GetTravelTime(line, route, stops.front(), stops.back())
+            );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    };
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(testFilePath))};
+    BOOST_REQUIRE(ok);
+
+    // route_0: 0 ---> 1 ---> 2
+    const auto rejected {nw.SetTravelTimes({
+        {"station_0", "station_1", 4},
+        {"station_0", "station_2", 5},  // Not adjacent
+        {"station_2", "station_1", 6},
+        {"station_42", "station_1", 7}, // Unknown station
+        {"station_1", "station_0", 8},  // Wins over the first entry
+    })};
+    BOOST_CHECK(rejected == std::vector<size_t>({1, 3}));
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 8);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_2"), 6);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 8 + 6
+    );
+    BOOST_CHECK(nw.SetTravelTimes({}).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // TravelTime
+
+BOOST_AUTO_TEST_SUITE(Freeze);
+
+BOOST_AUTO_TEST_CASE(add_after_freeze)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2
+    // route1: 3 ---> 2 (added after the network is frozen)
+    Station station0 {
+        "station_000",
+        "Station Name 0",
+    };
+    Station station1 {
+        "station_001",
+        "Station Name 1",
+    };
+    Station station2 {
+        "station_002",
+        "Station Name 2",
+    };
+    Station station3 {
+        "station_003",
+        "Station Name 3",
+    };
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_001",
+        "station_003",
+        "station_002",
+        {"station_003", "station_002"},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route1},
+    };
+    ok = true;
+    ok &= nw.AddStation(station0);
+    ok &= nw.AddStation(station1);
+    ok &= nw.AddStation(station2);
+    BOOST_REQUIRE(ok);
+    ok = nw.AddLine(line0);
+    BOOST_REQUIRE(ok);
+
+    nw.Freeze();
+    BOOST_REQUIRE(nw.IsFrozen());
+
+    // Adjacency queries work on the compact graph.
+    BOOST_CHECK(nw.SetTravelTime(station0.id, station1.id, 1));
+    BOOST_CHECK(nw.SetTravelTime(station2.id, station1.id, 2));
+    BOOST_CHECK(!nw.SetTravelTime(station0.id, station2.id, 3));
+
+    // Adding a station keeps the network frozen, adding a line does not.
+    ok = nw.AddStation(station3);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.IsFrozen());
+    BOOST_CHECK(!nw.SetTravelTime(station3.id, station2.id, 4));
+    ok = nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!nw.IsFrozen());
+    BOOST_CHECK(nw.SetTravelTime(station3.id, station2.id, 4));
+    BOOST_CHECK(nw.SetTravelTime(station0.id, station1.id, 1));
+
+    nw.Freeze();
+    BOOST_CHECK(nw.IsFrozen());
+    BOOST_CHECK(nw.SetTravelTime(station2.id, station3.id, 5));
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime(line0.id, route0.id, station0.id, station2.id), 1 + 2
+    );
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // Freeze
+
+BOOST_AUTO_TEST_SUITE(GetFastestPath);
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2
+    // route1: 2 ---> 3
+    // route2: 0 ---> 4 ---> 5 ---> 3
+    std::vector<Station> stations {};
+    for (int i = 0; i < 6; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_002",
+        "station_003",
+        {"station_002", "station_003"},
+    };
+    Route route2 {
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_003",
+        {"station_000", "station_004", "station_005", "station_003"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0, route1},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.AddLine(line0);
+    ok &= nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_002", 1);
+    ok &= nw.SetTravelTime("station_002", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_004", 2);
+    ok &= nw.SetTravelTime("station_004", "station_005", 2);
+    ok &= nw.SetTravelTime("station_005", "station_003", 2);
+    BOOST_REQUIRE(ok);
+
+    // Without a penalty, changing route at station 2 is fastest.
+    TravelRoute travelRoute {nw.GetFastestPath("station_000", "station_003")};
+    BOOST_CHECK_EQUAL(travelRoute.startStationId, "station_000");
+    BOOST_CHECK_EQUAL(travelRoute.endStationId, "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 3);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 3);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].startStationId, "station_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].endStationId, "station_001");
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps[2].startStationId, "station_002");
+    BOOST_CHECK_EQUAL(travelRoute.steps[2].endStationId, "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.steps[2].lineId, "line_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps[2].routeId, "route_001");
+    BOOST_CHECK_EQUAL(travelRoute.steps[2].travelTime, 1);
+
+    // A high penalty makes the direct route more convenient.
+    travelRoute = nw.GetFastestPath("station_000", "station_003", 10);
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 6);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 3);
+    for (const auto& step : travelRoute.steps) {
+        BOOST_CHECK_EQUAL(step.lineId, "line_001");
+        BOOST_CHECK_EQUAL(step.routeId, "route_002");
+    }
+
+    // Routes only run in one direction.
+    travelRoute = nw.GetFastestPath("station_003", "station_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps.size(), 0);
+    travelRoute = nw.GetFastestPath("station_000", "station_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps.size(), 0);
+    travelRoute = nw.GetFastestPath("station_000", "station_42");
+    BOOST_CHECK_EQUAL(travelRoute.steps.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    // The steps of the journey are contiguous and add up to the total.
+    for (unsigned int penalty : {0, 5}) {
+        auto travelRoute {nw.GetFastestPath("station_000", "station_200", penalty)};
+        BOOST_REQUIRE(!travelRoute.steps.empty());
+        BOOST_CHECK_EQUAL(travelRoute.steps.front().startStationId, "station_000");
+        BOOST_CHECK_EQUAL(travelRoute.steps.back().endStationId, "station_200");
+        unsigned int totalTravelTime {0};
+        for (size_t i = 0; i < travelRoute.steps.size(); ++i) {
+            const auto& step {travelRoute.steps[i]};
+            if (i > 0) {
+                BOOST_CHECK_EQUAL(
+                    step.startStationId,
+                    travelRoute.steps[i - 1].endStationId
+                );
+            }
+            BOOST_CHECK_EQUAL(
+                step.travelTime,
+                nw.GetTravelTime(step.startStationId, step.endStationId)
+            );
+            totalTravelTime += step.travelTime;
+        }
+        BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, totalTravelTime);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetFastestPath
+
+BOOST_AUTO_TEST_SUITE(GetAlternativeRoutes);
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2 ---> 3
+    // route1: 1 ---> 5
+    // route2: 0 ---> 4 ---> 5 ---> 3
+    std::vector<Station> stations {};
+    for (int i = 0; i < 6; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_003",
+        {"station_000", "station_001", "station_002", "station_003"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_001",
+        "station_005",
+        {"station_001", "station_005"},
+    };
+    Route route2 {
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_003",
+        {"station_000", "station_004", "station_005", "station_003"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0, route1},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.AddLine(line0);
+    ok &= nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_002", 1);
+    ok &= nw.SetTravelTime("station_002", "station_003", 1);
+    ok &= nw.SetTravelTime("station_001", "station_005", 1);
+    ok &= nw.SetTravelTime("station_000", "station_004", 2);
+    ok &= nw.SetTravelTime("station_004", "station_005", 2);
+    ok &= nw.SetTravelTime("station_005", "station_003", 2);
+    BOOST_REQUIRE(ok);
+
+    // There are only three journeys, returned fastest first.
+    auto travelRoutes {nw.GetAlternativeRoutes("station_000", "station_003", 5)};
+    BOOST_REQUIRE_EQUAL(travelRoutes.size(), 3);
+    BOOST_CHECK_EQUAL(travelRoutes[0].totalTravelTime, 3);
+    BOOST_CHECK_EQUAL(travelRoutes[1].totalTravelTime, 4);
+    BOOST_CHECK_EQUAL(travelRoutes[2].totalTravelTime, 6);
+    for (const auto& travelRoute : travelRoutes) {
+        BOOST_CHECK_EQUAL(travelRoute.startStationId, "station_000");
+        BOOST_CHECK_EQUAL(travelRoute.endStationId, "station_003");
+        BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 3);
+    }
+
+    // The first journey stays on route 0.
+    for (const auto& step : travelRoutes[0].steps) {
+        BOOST_CHECK_EQUAL(step.routeId, "route_000");
+    }
+
+    // The second journey changes route at station 1 and at station 5.
+    const auto& steps {travelRoutes[1].steps};
+    BOOST_CHECK_EQUAL(steps[0].routeId, "route_000");
+    BOOST_CHECK_EQUAL(steps[1].startStationId, "station_001");
+    BOOST_CHECK_EQUAL(steps[1].endStationId, "station_005");
+    BOOST_CHECK_EQUAL(steps[1].lineId, "line_000");
+    BOOST_CHECK_EQUAL(steps[1].routeId, "route_001");
+    BOOST_CHECK_EQUAL(steps[1].travelTime, 1);
+    BOOST_CHECK_EQUAL(steps[2].lineId, "line_001");
+    BOOST_CHECK_EQUAL(steps[2].routeId, "route_002");
+    BOOST_CHECK_EQUAL(steps[2].travelTime, 2);
+
+    // Asking for fewer journeys returns the fastest ones.
+    travelRoutes = nw.GetAlternativeRoutes("station_000", "station_003", 2);
+    BOOST_REQUIRE_EQUAL(travelRoutes.size(), 2);
+    BOOST_CHECK_EQUAL(travelRoutes[1].totalTravelTime, 4);
+
+    // Routes only run in one direction.
+    travelRoutes = nw.GetAlternativeRoutes("station_003", "station_000", 3);
+    BOOST_CHECK_EQUAL(travelRoutes.size(), 0);
+    travelRoutes = nw.GetAlternativeRoutes("station_000", "station_000", 3);
+    BOOST_CHECK_EQUAL(travelRoutes.size(), 0);
+    travelRoutes = nw.GetAlternativeRoutes("station_000", "station_42", 3);
+    BOOST_CHECK_EQUAL(travelRoutes.size(), 0);
+    travelRoutes = nw.GetAlternativeRoutes("station_000", "station_003", 0);
+    BOOST_CHECK_EQUAL(travelRoutes.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    const size_t k {5};
+    const auto start {std::chrono::steady_clock::now()};
+    auto travelRoutes {nw.GetAlternativeRoutes("station_000", "station_200", k)};
+    const auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "GetAlternativeRoutes (k = " << k << "): " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() <<
+        " us"
+    );
+    BOOST_REQUIRE(!travelRoutes.empty());
+    BOOST_CHECK_EQUAL(
+        travelRoutes.front().totalTravelTime,
+        nw.GetFastestTravelTime("station_000", "station_200")
+    );
+
+    // The journeys are distinct, loopless and sorted, and their steps add up
+    // to their totals.
+    std::set<std::vector<Id>> journeys {};
+    for (size_t i = 0; i < travelRoutes.size(); ++i) {
+        const auto& travelRoute {travelRoutes[i]};
+        if (i > 0) {
+            BOOST_CHECK_LE(
+                travelRoutes[i - 1].totalTravelTime,
+                travelRoute.totalTravelTime
+            );
+        }
+        BOOST_REQUIRE(!travelRoute.steps.empty());
+        std::vector<Id> stops {travelRoute.steps.front().startStationId};
+        unsigned int totalTravelTime {0};
+        for (const auto& step : travelRoute.steps) {
+            BOOST_CHECK_EQUAL(step.startStationId, stops.back());
+            BOOST_CHECK_EQUAL(
+                step.travelTime,
+                nw.GetTravelTime(step.startStationId, step.endStationId)
+            );
+            totalTravelTime += step.travelTime;
+            stops.push_back(step.endStationId);
+        }
+        BOOST_CHECK_EQUAL(stops.front(), "station_000");
+        BOOST_CHECK_EQUAL(stops.back(), "station_200");
+        BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, totalTravelTime);
+        BOOST_CHECK_EQUAL(
+            std::set<Id>(stops.begin(), stops.end()).size(),
+            stops.size()
+        );
+        BOOST_CHECK(journeys.insert(stops).second);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetAlternativeRoutes
+
+BOOST_AUTO_TEST_SUITE(Crowding);
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2
+    // route1: 2 ---> 3
+    // route2: 0 ---> 4 ---> 5 ---> 3
+    std::vector<Station> stations {};
+    for (int i = 0; i < 6; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_002",
+        "station_003",
+        {"station_002", "station_003"},
+    };
+    Route route2 {
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_003",
+        {"station_000", "station_004", "station_005", "station_003"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0, route1},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.AddLine(line0);
+    ok &= nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_002", 1);
+    ok &= nw.SetTravelTime("station_002", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_004", 2);
+    ok &= nw.SetTravelTime("station_004", "station_005", 2);
+    ok &= nw.SetTravelTime("station_005", "station_003", 2);
+    BOOST_REQUIRE(ok);
+
+    // Without a cost function, steps cost their travel time.
+    TravelRoute travelRoute {nw.GetLeastCrowdedPath("station_000", "station_003")};
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 3);
+    BOOST_CHECK_EQUAL(nw.GetCrowdedTravelTime("station_001", "station_002"), 1);
+
+    // Crowded stations make the steps into them 10 times slower.
+    size_t nCalls {0};
+    nw.SetCrowdingCost({10}, [&nCalls](unsigned int travelTime, size_t level) {
+        ++nCalls;
+        return travelTime * (level > 0 ? 10 : 1);
+    });
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 3);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 3);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_000");
+    BOOST_CHECK_GT(nCalls, 0);
+
+    // Costs are cached while no station changes crowding level.
+    size_t nCached {nCalls};
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(nCalls, nCached);
+    for (int i = 0; i < 9; ++i) {
+        ok &= nw.RecordPassengerEvent({"station_002", PassengerEvent::Type::In});
+    }
+    BOOST_REQUIRE(ok);
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(nCalls, nCached);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_000");
+
+    // Station 2 gets crowded: the journey avoids it.
+    ok &= nw.RecordPassengerEvent({"station_002", PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(nw.GetCrowdedTravelTime("station_001", "station_002"), 10);
+    BOOST_CHECK_EQUAL(nw.GetCrowdedTravelTime("station_002", "station_001"), 1);
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 6);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 3);
+    for (const auto& step : travelRoute.steps) {
+        BOOST_CHECK_EQUAL(step.routeId, "route_002");
+    }
+    BOOST_CHECK_GT(nCalls, nCached);
+    nCached = nCalls;
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(nCalls, nCached);
+
+    // The plain search ignores crowding.
+    travelRoute = nw.GetFastestPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 3);
+
+    // Travel time changes are picked up.
+    ok &= nw.SetTravelTime("station_004", "station_005", 20);
+    BOOST_REQUIRE(ok);
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_003");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 3);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_000");
+
+    BOOST_CHECK_EQUAL(nw.GetCrowdedTravelTime("station_000", "station_003"), 0);
+    BOOST_CHECK_EQUAL(nw.GetCrowdedTravelTime("station_000", "station_42"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(set_travel_times)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2
+    // route1: 0 ---> 2
+    std::vector<Station> stations {};
+    for (int i = 0; i < 3; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_002",
+        {"station_000", "station_002"},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    ok &= nw.AddLine({"line_000", "Line Name 0", {route0}});
+    ok &= nw.AddLine({"line_001", "Line Name 1", {route1}});
+    BOOST_REQUIRE(ok);
+    BOOST_REQUIRE(nw.SetTravelTimes({
+        {"station_000", "station_001", 1},
+        {"station_001", "station_002", 1},
+        {"station_000", "station_002", 50},
+    }).empty());
+
+    nw.SetCrowdingCost({10}, [](unsigned int travelTime, size_t) {
+        return travelTime;
+    });
+    auto travelRoute {nw.GetLeastCrowdedPath("station_000", "station_002")};
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 2);
+
+    // Batch updates drop the cached costs of the steps they change.
+    BOOST_REQUIRE(nw.SetTravelTimes({
+        {"station_001", "station_002", 1000},
+    }).empty());
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_002");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 50);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 1);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_001");
+}
+
+BOOST_AUTO_TEST_CASE(suspend_station)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2 ---> 3 ---> 4
+    // route1: 0 ---> 4
+    std::vector<Station> stations {};
+    for (int i = 0; i < 5; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_004",
+        {"station_000", "station_001", "station_002", "station_003", "station_004"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_004",
+        {"station_000", "station_004"},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    ok &= nw.AddLine({"line_000", "Line Name 0", {route0}});
+    ok &= nw.AddLine({"line_001", "Line Name 1", {route1}});
+    BOOST_REQUIRE(ok);
+    BOOST_REQUIRE(nw.SetTravelTimes({
+        {"station_000", "station_001", 1},
+        {"station_001", "station_002", 1},
+        {"station_002", "station_003", 1},
+        {"station_003", "station_004", 100},
+        {"station_000", "station_004", 50},
+    }).empty());
+
+    nw.SetCrowdingCost({10}, [](unsigned int travelTime, size_t) {
+        return travelTime;
+    });
+    auto travelRoute {nw.GetLeastCrowdedPath("station_000", "station_004")};
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 50);
+
+    // The cached costs of a route do not move with its stops.
+    ok = nw.SuspendStation("station_002");
+    BOOST_REQUIRE(ok);
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_004");
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, 50);
+    BOOST_REQUIRE_EQUAL(travelRoute.steps.size(), 1);
+    BOOST_CHECK_EQUAL(travelRoute.steps[0].routeId, "route_001");
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    nw.SetCrowdingCost({100, 1000}, [](unsigned int travelTime, size_t level) {
+        return travelTime * static_cast<unsigned int>(1 + 4 * level);
+    });
+
+    // Uncrowded, the least crowded journey is the fastest one.
+    auto fastest {nw.GetFastestPath("station_000", "station_200")};
+    auto travelRoute {nw.GetLeastCrowdedPath("station_000", "station_200")};
+    BOOST_REQUIRE(!fastest.steps.empty());
+    BOOST_CHECK_EQUAL(travelRoute.totalTravelTime, fastest.totalTravelTime);
+
+    // Crowd the stations in the middle of the fastest journey.
+    std::vector<PassengerEvent> events {};
+    for (size_t i = 0; i + 1 < fastest.steps.size(); ++i) {
+        for (int j = 0; j < 1000; ++j) {
+            events.push_back({
+                fastest.steps[i].endStationId,
+                PassengerEvent::Type::In
+            });
+        }
+    }
+    BOOST_REQUIRE(nw.RecordPassengerEvents(events).empty());
+
+    const auto start {std::chrono::steady_clock::now()};
+    travelRoute = nw.GetLeastCrowdedPath("station_000", "station_200");
+    const auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "GetLeastCrowdedPath: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() <<
+        " us"
+    );
+    BOOST_REQUIRE(!travelRoute.steps.empty());
+    BOOST_CHECK_EQUAL(travelRoute.steps.front().startStationId, "station_000");
+    BOOST_CHECK_EQUAL(travelRoute.steps.back().endStationId, "station_200");
+    BOOST_CHECK_GE(travelRoute.totalTravelTime, fastest.totalTravelTime);
+
+    // The journey costs no more than the fastest one, with crowding.
+    unsigned int cost {0};
+    unsigned int fastestCost {0};
+    for (const auto& step : travelRoute.steps) {
+        cost += nw.GetCrowdedTravelTime(step.startStationId, step.endStationId);
+    }
+    for (const auto& step : fastest.steps) {
+        fastestCost += nw.GetCrowdedTravelTime(
+            step.startStationId,
+            step.endStationId
+        );
+    }
+    BOOST_CHECK_LE(cost, fastestCost);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // Crowding
+
+BOOST_AUTO_TEST_SUITE(GetReachableStations);
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    TransportNetwork nw {};
+    bool ok {false};
+
+    // route0: 0 ---> 1 ---> 2
+    // route1: 2 ---> 3
+    // route2: 0 ---> 4 ---> 5 ---> 3
+    std::vector<Station> stations {};
+    for (int i = 0; i < 6; ++i) {
+        stations.push_back({
+            "station_00" + std::to_string(i),
+            "Station Name " + std::to_string(i),
+        });
+    }
+    Route route0 {
+        "route_000",
+        "inbound",
+        "line_000",
+        "station_000",
+        "station_002",
+        {"station_000", "station_001", "station_002"},
+    };
+    Route route1 {
+        "route_001",
+        "inbound",
+        "line_000",
+        "station_002",
+        "station_003",
+        {"station_002", "station_003"},
+    };
+    Route route2 {
+        "route_002",
+        "inbound",
+        "line_001",
+        "station_000",
+        "station_003",
+        {"station_000", "station_004", "station_005", "station_003"},
+    };
+    Line line0 {
+        "line_000",
+        "Line Name 0",
+        {route0, route1},
+    };
+    Line line1 {
+        "line_001",
+        "Line Name 1",
+        {route2},
+    };
+    ok = true;
+    for (const auto& station : stations) {
+        ok &= nw.AddStation(station);
+    }
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.AddLine(line0);
+    ok &= nw.AddLine(line1);
+    BOOST_REQUIRE(ok);
+    ok = true;
+    ok &= nw.SetTravelTime("station_000", "station_001", 1);
+    ok &= nw.SetTravelTime("station_001", "station_002", 1);
+    ok &= nw.SetTravelTime("station_002", "station_003", 1);
+    ok &= nw.SetTravelTime("station_000", "station_004", 2);
+    ok &= nw.SetTravelTime("station_004", "station_005", 2);
+    ok &= nw.SetTravelTime("station_005", "station_003", 2);
+    BOOST_REQUIRE(ok);
+
+    auto reachable {nw.GetReachableStations("station_000", 3)};
+    BOOST_REQUIRE_EQUAL(reachable.size(), 4);
+    BOOST_CHECK_EQUAL(reachable[0].stationId, "station_001");
+    BOOST_CHECK_EQUAL(reachable[0].travelTime, 1);
+    BOOST_CHECK_EQUAL(reachable[1].stationId, "station_002");
+    BOOST_CHECK_EQUAL(reachable[1].travelTime, 2);
+    BOOST_CHECK_EQUAL(reachable[2].stationId, "station_004");
+    BOOST_CHECK_EQUAL(reachable[2].travelTime, 2);
+    BOOST_CHECK_EQUAL(reachable[3].stationId, "station_003");
+    BOOST_CHECK_EQUAL(reachable[3].travelTime, 3);
+
+    // A larger budget reaches station 5; travel times are still the fastest.
+    reachable = nw.GetReachableStations("station_000", 100);
+    BOOST_REQUIRE_EQUAL(reachable.size(), 5);
+    BOOST_CHECK_EQUAL(reachable[4].stationId, "station_005");
+    BOOST_CHECK_EQUAL(reachable[4].travelTime, 4);
+
+    // Routes only run in one direction.
+    reachable = nw.GetReachableStations("station_003", 100);
+    BOOST_CHECK(reachable.empty());
+    reachable = nw.GetReachableStations("station_000", 0);
+    BOOST_CHECK(reachable.empty());
+    reachable = nw.GetReachableStations("station_42", 100);
+    BOOST_CHECK(reachable.empty());
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    // The first query on a thread sizes its search state.
+    BOOST_REQUIRE(!nw.GetReachableStations("station_000", 5).empty());
+
+    // The travel times are the fastest ones, and repeated queries give the
+    // same stations.
+    for (unsigned int maxTravelTime : {5, 20, 1000}) {
+        const auto start {std::chrono::steady_clock::now()};
+        auto reachable {nw.GetReachableStations("station_000", maxTravelTime)};
+        const auto elapsed {std::chrono::steady_clock::now() - start};
+        BOOST_TEST_MESSAGE(
+            "GetReachableStations (" << maxTravelTime << ", " <<
+            reachable.size() << " stations): " <<
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() <<
+            " us"
+        );
+        BOOST_REQUIRE(!reachable.empty());
+        for (size_t i = 0; i < reachable.size(); ++i) {
+            const auto& station {reachable[i]};
+            BOOST_CHECK_LE(station.travelTime, maxTravelTime);
+            if (i > 0) {
+                BOOST_CHECK_LE(reachable[i - 1].travelTime, station.travelTime);
+            }
+            BOOST_CHECK_EQUAL(
+                station.travelTime,
+                nw.GetFastestTravelTime("station_000", station.stationId)
+            );
+        }
+        auto again {nw.GetReachableStations("station_000", maxTravelTime)};
+        BOOST_CHECK_EQUAL(again.size(), reachable.size());
+    }
+
+    // With an unlimited budget, every station with a journey is reachable.
+    auto reachable {nw.GetReachableStations(
+        "station_000",
+        std::numeric_limits<unsigned int>::max()
+    )};
+    const auto ids {nw.GetStationIds()};
+    size_t nReachable {0};
+    for (const auto& id : ids) {
+        if (id != "station_000" &&
+            nw.GetFastestTravelTime("station_000", Id {id}) > 0) {
+            ++nReachable;
+        }
+    }
+    BOOST_CHECK_EQUAL(reachable.size(), nReachable);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetReachableStations
+
+BOOST_AUTO_TEST_SUITE(TravelTimeMatrix);
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+    BOOST_REQUIRE(!nw.HasTravelTimeMatrix());
+
+    // Searches without the matrix agree with the journey planner.
+    const std::vector<std::pair<Id, Id>> pairs {
+        {"station_000", "station_200"},
+        {"station_017", "station_300"},
+        {"station_250", "station_001"},
+        {"station_100", "station_101"},
+    };
+    std::vector<unsigned int> travelTimes {};
+    for (const auto& pair : pairs) {
+        auto travelTime {nw.GetFastestTravelTime(pair.first, pair.second)};
+        BOOST_CHECK_EQUAL(
+            travelTime,
+            nw.GetFastestPath(pair.first, pair.second).totalTravelTime
+        );
+        travelTimes.push_back(travelTime);
+    }
+
+    auto start {std::chrono::steady_clock::now()};
+    nw.BuildTravelTimeMatrix();
+    auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "BuildTravelTimeMatrix: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+        << " us"
+    );
+    BOOST_CHECK(elapsed < std::chrono::seconds(1));
+    BOOST_REQUIRE(nw.HasTravelTimeMatrix());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        BOOST_CHECK_EQUAL(
+            nw.GetFastestTravelTime(pairs[i].first, pairs[i].second),
+            travelTimes[i]
+        );
+    }
+
+    // Incremental updates match a full rebuild.
+    TransportNetwork reference {};
+    ok = reference.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT));
+    BOOST_REQUIRE(ok);
+    const std::vector<std::pair<Id, Id>> edges {
+        {"station_000", "station_001"},
+        {"station_001", "station_002"},
+        {"station_100", "station_101"},
+    };
+    for (unsigned int travelTime : {30, 1, 2}) {
+        for (const auto& edge : edges) {
+            ok = true;
+            ok &= nw.SetTravelTime(edge.first, edge.second, travelTime);
+            ok &= reference.SetTravelTime(edge.first, edge.second, travelTime);
+            BOOST_REQUIRE(ok);
+        }
+        reference.BuildTravelTimeMatrix(1);
+        for (int a = 0; a < 400; a += 7) {
+            for (int b = 0; b < 400; b += 3) {
+                char idA[16];
+                char idB[16];
+                std::snprintf(idA, sizeof(idA), "station_%03d", a);
+                std::snprintf(idB, sizeof(idB), "station_%03d", b);
+                BOOST_CHECK_EQUAL(
+                    nw.GetFastestTravelTime(idA, idB),
+                    reference.GetFastestTravelTime(idA, idB)
+                );
+            }
+        }
+    }
+
+    // Changing the layout drops the matrix.
+    ok = nw.AddStation({"station_new", "New Station"});
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!nw.HasTravelTimeMatrix());
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // TravelTimeMatrix
+
+BOOST_AUTO_TEST_SUITE(ContractionHierarchy);
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    TransportNetwork plain {};
+    auto ok {plain.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    TransportNetwork nw {plain};
+    nw.BuildContractionHierarchy();
+    BOOST_REQUIRE(nw.HasContractionHierarchy());
+
+    std::vector<std::pair<Id, Id>> pairs {};
+    for (int a = 0; a < 420; a += 11) {
+        for (int b = 0; b < 420; b += 13) {
+            char idA[16];
+            char idB[16];
+            std::snprintf(idA, sizeof(idA), "station_%03d", a);
+            std::snprintf(idB, sizeof(idB), "station_%03d", b);
+            pairs.emplace_back(idA, idB);
+        }
+    }
+
+    // Same answers as the plain search, compared against its latency.
+    std::vector<unsigned int> expected {};
+    auto start {std::chrono::steady_clock::now()};
+    for (const auto& pair : pairs) {
+        expected.push_back(plain.GetFastestTravelTime(pair.first, pair.second));
+    }
+    auto plainElapsed {std::chrono::steady_clock::now() - start};
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        BOOST_CHECK_EQUAL(
+            nw.GetFastestTravelTime(pairs[i].first, pairs[i].second),
+            expected[i]
+        );
+    }
+    auto hierarchyElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "GetFastestTravelTime over " << pairs.size() << " pairs: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            plainElapsed
+        ).count() << " us with Dijkstra, " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            hierarchyElapsed
+        ).count() << " us with the contraction hierarchy"
+    );
+
+    // The hierarchy can be stored and loaded back.
+    TransportNetwork loaded {plain};
+    ok = loaded.LoadContractionHierarchy(nw.GetContractionHierarchyJson());
+    BOOST_REQUIRE(ok);
+    BOOST_REQUIRE(loaded.HasContractionHierarchy());
+    for (size_t i = 0; i < pairs.size(); i += 5) {
+        BOOST_CHECK_EQUAL(
+            loaded.GetFastestTravelTime(pairs[i].first, pairs[i].second),
+            expected[i]
+        );
+    }
+
+    // Changing a travel time drops the hierarchy.
+    ok = nw.SetTravelTime("station_000", "station_001", 42);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!nw.HasContractionHierarchy());
+}
+
+BOOST_AUTO_TEST_CASE(load_mismatch)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+    nw.BuildContractionHierarchy();
+    auto hierarchy = nw.GetContractionHierarchyJson();
+
+    // A hierarchy built for a different network is rejected.
+    TransportNetwork other {};
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    };
+    ok = other.FromJson(ParseJsonFile(testFilePath));
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!other.LoadContractionHierarchy(hierarchy));
+    BOOST_CHECK(!other.HasContractionHierarchy());
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // ContractionHierarchy
+
+BOOST_AUTO_TEST_SUITE(FromJson);
+
+std::vector<Id> GetSortedIds(std::vector<Id>& routes) {
+    std::vector<Id> ids {routes};
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+BOOST_AUTO_TEST_CASE(from_json_1line_1route) {
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_1line_1route.json"
+    };
+
+    auto src = ParseJsonFile(testFilePath);
+
+    TransportNetwork nw {};
+
+    auto ok {nw.FromJson(std::move(src))};
+    BOOST_REQUIRE(ok);
+
+    auto routes {nw.GetRoutesServingStation("station_0")};
+    BOOST_REQUIRE_EQUAL(routes.size(), 1);
+    BOOST_CHECK_EQUAL(routes[0], "route_0");
+}
+
+BOOST_AUTO_TEST_CASE(from_json_1line_2routes) {
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_1line_2routes.json"
+    };
+
+    auto src = ParseJsonFile(testFilePath);
+
+    TransportNetwork nw {};
 
-    auto src = ParseJsonFile(testFilePath);
-
-    TransportNetwork nw {};
-
     auto ok {nw.FromJson(std::move(src))};
     BOOST_REQUIRE(ok);
 
@@ -621,6 +2371,19 @@ BOOST_AUTO_TEST_CASE(from_json_travel_times) {
     BOOST_CHECK_EQUAL(nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 1 + 2);
 }
 
+BOOST_AUTO_TEST_CASE(from_json_full_layout) {
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+
+    TransportNetwork nw {};
+
+    auto ok {nw.FromJson(std::move(src))};
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.IsFrozen());
+
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_000", "station_001"), 2);
+    BOOST_CHECK(!nw.GetRoutesServingStation("station_000").empty());
+}
+
 BOOST_AUTO_TEST_CASE(fail_on_bad_json) {
     nlohmann::json src {
         {"lines", {}},
@@ -663,8 +2426,936 @@ BOOST_AUTO_TEST_CASE(fail_on_bad_travel_times){
     BOOST_REQUIRE(!ok);
 }
 
+BOOST_AUTO_TEST_CASE(from_json_allocations)
+{
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+    std::vector<Station> stations {};
+    for (const auto& stationJson : src.at("stations")) {
+        stations.push_back({
+            stationJson.at("station_id").get<Id>(),
+            stationJson.at("name").get<std::string>()
+        });
+    }
+    std::vector<Line> lines {};
+    size_t nStops {0};
+    for (const auto& lineJson : src.at("lines")) {
+        Line line {
+            lineJson.at("line_id").get<Id>(),
+            lineJson.at("name").get<std::string>(),
+            {}
+        };
+        for (const auto& routeJson : lineJson.at("routes")) {
+            line.routes.push_back({
+                routeJson.at("route_id").get<Id>(),
+                routeJson.at("direction").get<std::string>(),
+                routeJson.at("line_id").get<Id>(),
+                routeJson.at("start_station_id").get<Id>(),
+                routeJson.at("end_station_id").get<Id>(),
+                routeJson.at("route_stops").get<std::vector<Id>>()
+            });
+            nStops += line.routes.back().stops.size();
+        }
+        lines.push_back(line);
+    }
+
+    auto load {[&stations, &lines](TransportNetwork& nw) {
+        const size_t allocations {gAllocations};
+        for (const auto& station : stations) {
+            BOOST_REQUIRE(nw.AddStation(station));
+        }
+        for (const auto& line : lines) {
+            BOOST_REQUIRE(nw.AddLine(line));
+        }
+        return gAllocations - allocations;
+    }};
+
+    TransportNetwork nw {};
+    const size_t loadAllocations {load(nw)};
+
+    // Strings go to the arena of the network, so longer names do not make
+    // more allocations beyond a few more arena blocks.
+    for (auto& station : stations) {
+        station.name += std::string(64, '.');
+    }
+    TransportNetwork longNames {};
+    const size_t longNamesAllocations {load(longNames)};
+
+    // A copy shares the strings of the copied network.
+    size_t allocations {gAllocations};
+    TransportNetwork copied {nw};
+    const size_t copyAllocations {gAllocations - allocations};
+
+    BOOST_TEST_MESSAGE(
+        "Layout with " << nStops << " route stops: " <<
+        loadAllocations << " allocations to load, " <<
+        longNamesAllocations << " with long station names, " <<
+        copyAllocations << " to copy"
+    );
+
+    // Stop IDs are never copied and stop positions take no allocation per
+    // stop.
+    BOOST_CHECK_LT(loadAllocations, 2 * nStops);
+    BOOST_CHECK_LT(longNamesAllocations, loadAllocations + 8);
+    BOOST_CHECK_LT(copyAllocations, loadAllocations);
+    BOOST_CHECK(
+        copied.GetRoutesServingStation("station_000") ==
+        nw.GetRoutesServingStation("station_000")
+    );
+    BOOST_CHECK(
+        copied.GetStationName("station_000").data() ==
+        nw.GetStationName("station_000").data()
+    );
+}
+
+BOOST_AUTO_TEST_CASE(from_json_parallel)
+{
+    // Parsing lines on several threads gives the same network as the serial
+    // path.
+    for (const auto& testFilePath : {
+        std::filesystem::path(TEST_DATA) / "from_json_2lines_2routes.json",
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json",
+        std::filesystem::path(TESTS_NETWORK_LAYOUT),
+    }) {
+        auto src = ParseJsonFile(testFilePath);
+        TransportNetwork expected {};
+        auto ok {expected.FromJson(nlohmann::json(src))};
+        BOOST_REQUIRE(ok);
+
+        for (const unsigned int nThreads : {0u, 4u}) {
+            TransportNetwork nw {};
+            ok = nw.FromJson(nlohmann::json(src), nThreads);
+            BOOST_REQUIRE(ok);
+            BOOST_CHECK(nw.IsFrozen());
+
+            for (const auto& stationJson : src.at("stations")) {
+                const auto station {stationJson.at("station_id").get<Id>()};
+                BOOST_CHECK(
+                    nw.GetRoutesServingStation(station) ==
+                    expected.GetRoutesServingStation(station)
+                );
+            }
+            for (const auto& lineJson : src.at("lines")) {
+                for (const auto& routeJson : lineJson.at("routes")) {
+                    const auto stops {routeJson.at("route_stops").get<std::vector<Id>>()};
+                    const auto line {lineJson.at("line_id").get<Id>()};
+                    const auto route {routeJson.at("route_id").get<Id>()};
+                    BOOST_CHECK_EQUAL(
+                        nw.GetTravelTime(line, route, stops.front(), stops.back()),
+                        expected.GetTravelTime(line, route, stops.front(), stops.back())
+                    );
+                }
+            }
+        }
+    }
+
+    // The first bad line in file order is reported, as in the serial path.
+    auto makeLine {[](const std::string& lineId, const std::string& routeId,
+                      const std::string& lastStop) {
+        return nlohmann::json {
+            {"line_id", lineId},
+            {"name", lineId},
+            {"routes", {{
+                {"route_id", routeId},
+                {"direction", "inbound"},
+                {"line_id", lineId},
+                {"start_station_id", "station_0"},
+                {"end_station_id", lastStop},
+                {"route_stops", {"station_0", lastStop}},
+            }}},
+        };
+    }};
+    nlohmann::json base {
+        {"stations", {
+            {{"station_id", "station_0"}, {"name", "Station 0 Name"}},
+            {{"station_id", "station_1"}, {"name", "Station 1 Name"}},
+        }},
+        {"travel_times", nlohmann::json::array()},
+    };
+    auto missingKey = makeLine("line_3", "route_3", "station_1");
+    missingKey.erase("name");
+    const std::vector<nlohmann::json> badLines {
+        // Unknown stop, then a duplicate line.
+        {
+            makeLine("line_0", "route_0", "station_1"),
+            makeLine("line_1", "route_1", "station_2"),
+            makeLine("line_0", "route_2", "station_1"),
+        },
+        // Duplicate route, then a missing key.
+        {
+            makeLine("line_0", "route_0", "station_1"),
+            makeLine("line_1", "route_0", "station_1"),
+            missingKey,
+        },
+        // Missing key, then an unknown stop.
+        {
+            makeLine("line_0", "route_0", "station_1"),
+            missingKey,
+            makeLine("line_1", "route_1", "station_2"),
+        },
+    };
+    for (const auto& lines : badLines) {
+        auto src = base;
+        src["lines"] = lines;
+
+        std::string expectedError {};
+        try {
+            TransportNetwork nw {};
+            nw.FromJson(nlohmann::json(src));
+        } catch (const nlohmann::json::exception& e) {
+            expectedError = e.what();
+        }
+        BOOST_REQUIRE(!expectedError.empty());
+
+        std::string error {};
+        try {
+            TransportNetwork nw {};
+            nw.FromJson(nlohmann::json(src), 3);
+        } catch (const nlohmann::json::exception& e) {
+            error = e.what();
+        }
+        BOOST_CHECK_EQUAL(error, expectedError);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(from_json_stream)
+{
+    // The streaming parser gives the same network as the JSON object.
+    for (const auto& testFilePath : {
+        std::filesystem::path(TEST_DATA) / "from_json_1line_1route.json",
+        std::filesystem::path(TEST_DATA) / "from_json_1line_2routes.json",
+        std::filesystem::path(TEST_DATA) / "from_json_2lines_2routes.json",
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json",
+        std::filesystem::path(TESTS_NETWORK_LAYOUT),
+    }) {
+        auto src = ParseJsonFile(testFilePath);
+        std::ifstream file {testFilePath};
+        BOOST_REQUIRE(file.is_open());
+
+        TransportNetwork expected {};
+        auto ok {expected.FromJson(nlohmann::json(src))};
+        BOOST_REQUIRE(ok);
+        TransportNetwork nw {};
+        ok = nw.FromJson(file);
+        BOOST_REQUIRE(ok);
+        BOOST_CHECK(nw.IsFrozen());
+
+        for (const auto& stationJson : src.at("stations")) {
+            const auto station {stationJson.at("station_id").get<Id>()};
+            BOOST_CHECK(
+                nw.GetRoutesServingStation(station) ==
+                expected.GetRoutesServingStation(station)
+            );
+        }
+        for (const auto& travelTimeJson : src.at("travel_times")) {
+            const auto stationA {travelTimeJson.at("start_station_id").get<Id>()};
+            const auto stationB {travelTimeJson.at("end_station_id").get<Id>()};
+            BOOST_CHECK_EQUAL(
+                nw.GetTravelTime(stationA, stationB),
+                expected.GetTravelTime(stationA, stationB)
+            );
+        }
+        for (const auto& lineJson : src.at("lines")) {
+            for (const auto& routeJson : lineJson.at("routes")) {
+                const auto stops {routeJson.at("route_stops").get<std::vector<Id>>()};
+                const auto line {lineJson.at("line_id").get<Id>()};
+                const auto route {routeJson.at("route_id").get<Id>()};
+                BOOST_CHECK_EQUAL(
+                    nw.GetTravelTime(line, route, stops.front(), stops.back()),
+                    expected.GetTravelTime(line, route, stops.front(), stops.back())
+                );
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(from_json_stream_errors)
+{
+    // Travel times between non-adjacent stations.
+    {
+        std::ifstream file {
+            std::filesystem::path(TEST_DATA) / "from_json_bad_travel_times.json"
+        };
+        TransportNetwork nw {};
+        BOOST_CHECK(!nw.FromJson(file));
+    }
+
+    // Malformed JSON, missing sections, items, and keys, and wrong types.
+    const std::vector<std::string> badSources {
+        R"({"stations": [)",
+        R"({"lines": [], "travel_times": []})",
+        R"({"stations": [], "lines": []})",
+        R"({"stations": [{"station_id": "station_0"}], "lines": [], "travel_times": []})",
+        R"({"stations": [{"station_id": 0, "name": "Station 0"}], "lines": [], "travel_times": []})",
+        R"({"stations": [
+            {"station_id": "station_0", "name": "Station 0 Name"},
+            {"station_id": "station_0", "name": "Station 0 Name"}
+        ], "lines": [], "travel_times": []})",
+        R"({"stations": [], "lines": [{"line_id": "line_0", "name": "Line 0", "routes": [
+            {"route_id": "route_0", "direction": "inbound", "line_id": "line_0",
+             "start_station_id": "station_0", "end_station_id": "station_1",
+             "route_stops": ["station_0", "station_1"]}
+        ]}], "travel_times": []})",
+    };
+    for (const auto& badSource : badSources) {
+        std::istringstream src {badSource};
+        TransportNetwork nw {};
+        BOOST_CHECK_THROW(nw.FromJson(src), nlohmann::json::exception);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END(); // FromJson
 
+BOOST_AUTO_TEST_SUITE(ApplyLayoutDiff);
+
+// Check that two networks agree on the stations, routes, and travel times of a
+// layout.
+void CheckSameLayout(
+    const TransportNetwork& nw,
+    const TransportNetwork& expected,
+    const nlohmann::json& layout
+)
+{
+    for (const auto& stationJson : layout.at("stations")) {
+        const auto station {stationJson.at("station_id").get<Id>()};
+        BOOST_CHECK(
+            nw.GetRoutesServingStation(station) ==
+            expected.GetRoutesServingStation(station)
+        );
+        BOOST_CHECK_EQUAL(
+            nw.GetStationName(station),
+            expected.GetStationName(station)
+        );
+    }
+    for (const auto& travelTimeJson : layout.at("travel_times")) {
+        const auto stationA {travelTimeJson.at("start_station_id").get<Id>()};
+        const auto stationB {travelTimeJson.at("end_station_id").get<Id>()};
+        BOOST_CHECK_EQUAL(
+            nw.GetTravelTime(stationA, stationB),
+            expected.GetTravelTime(stationA, stationB)
+        );
+    }
+    for (const auto& lineJson : layout.at("lines")) {
+        const auto line {lineJson.at("line_id").get<Id>()};
+        BOOST_CHECK_EQUAL(nw.GetLineName(line), expected.GetLineName(line));
+        for (const auto& routeJson : lineJson.at("routes")) {
+            const auto stops {routeJson.at("route_stops").get<std::vector<Id>>()};
+            const auto route {routeJson.at("route_id").get<Id>()};
+            BOOST_CHECK_EQUAL(
+                nw.GetTravelTime(line, route, stops.front(), stops.back()),
+                expected.GetTravelTime(line, route, stops.front(), stops.back())
+            );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    };
+    auto src = ParseJsonFile(testFilePath);
+
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+    ok &= nw.RecordPassengerEvent({"station_1", PassengerEvent::Type::In});
+    ok &= nw.RecordPassengerEvent({"station_1", PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+
+    // Rename a station and extend the route to a new station.
+    src["stations"][2]["name"] = "Station 2 New Name";
+    src["stations"].push_back({
+        {"station_id", "station_3"},
+        {"name", "Station 3 Name"},
+    });
+    src["lines"][0]["routes"][0]["route_stops"].push_back("station_3");
+    src["lines"][0]["routes"][0]["end_station_id"] = "station_3";
+    src["travel_times"][1]["travel_time"] = 5;
+    src["travel_times"].push_back({
+        {"start_station_id", "station_2"},
+        {"end_station_id", "station_3"},
+        {"travel_time", 3},
+    });
+    ok = nw.ApplyLayoutDiff(src);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.IsFrozen());
+
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_1"), 2);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_3"), 0);
+    BOOST_CHECK_EQUAL(nw.GetStationName("station_2"), "Station 2 New Name");
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_2"), 5);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_2", "station_3"), 3);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_0", "station_3"),
+        1 + 5 + 3
+    );
+    auto routes {nw.GetRoutesServingStation("station_3")};
+    BOOST_REQUIRE_EQUAL(routes.size(), 1);
+    BOOST_CHECK_EQUAL(routes[0], "route_0");
+
+    // Remove the first station, with the travel time that went with it.
+    src["stations"].erase(0);
+    src["lines"][0]["routes"][0]["route_stops"].erase(0);
+    src["lines"][0]["routes"][0]["start_station_id"] = "station_1";
+    src["travel_times"].erase(0);
+    ok = nw.ApplyLayoutDiff(src);
+    BOOST_REQUIRE(ok);
+
+    BOOST_CHECK(nw.GetRoutesServingStation("station_0").empty());
+    BOOST_CHECK_THROW(nw.GetPassengerCount("station_0"), std::runtime_error);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 0);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_1"), 2);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_1", "station_3"),
+        5 + 3
+    );
+
+    // The station can come back, with new counters.
+    ok = nw.AddStation({"station_0", "Station 0 Name"});
+    BOOST_CHECK(ok);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_0"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+    const auto keptStation {
+        src.at("lines").back().at("routes")[0].at("route_stops")[0].get<Id>()
+    };
+    ok = nw.RecordPassengerEvent({keptStation, PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+
+    // Applying the same layout changes nothing.
+    auto start {std::chrono::steady_clock::now()};
+    ok = nw.ApplyLayoutDiff(src);
+    auto sameElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_REQUIRE(ok);
+    CheckSameLayout(nw, nw, src);
+
+    // Drop the first line, and the stations that only it served.
+    const auto removedLine {src.at("lines")[0].at("line_id").get<Id>()};
+    src["lines"].erase(0);
+    std::set<Id> servedStations {};
+    for (const auto& lineJson : src.at("lines")) {
+        for (const auto& routeJson : lineJson.at("routes")) {
+            for (const auto& stop : routeJson.at("route_stops")) {
+                servedStations.insert(stop.get<Id>());
+            }
+        }
+    }
+    auto& stationsJson {src["stations"]};
+    size_t nRemovedStations {stationsJson.size()};
+    stationsJson.erase(
+        std::remove_if(
+            stationsJson.begin(), stationsJson.end(),
+            [&servedStations](const nlohmann::json& stationJson) {
+                return servedStations.count(
+                    stationJson.at("station_id").get<Id>()
+                ) == 0;
+            }
+        ),
+        stationsJson.end()
+    );
+    nRemovedStations -= stationsJson.size();
+    BOOST_TEST_MESSAGE("Stations removed with the line: " << nRemovedStations);
+    src["travel_times"][0]["travel_time"] = 42;
+
+    TransportNetwork expected {};
+    start = std::chrono::steady_clock::now();
+    const auto expectedOk {expected.FromJson(nlohmann::json(src))};
+    auto jsonElapsed {std::chrono::steady_clock::now() - start};
+    start = std::chrono::steady_clock::now();
+    ok = nw.ApplyLayoutDiff(src);
+    auto diffElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "Full layout reload: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            jsonElapsed
+        ).count() << " us from JSON, " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            sameElapsed
+        ).count() << " us to apply the same layout, " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            diffElapsed
+        ).count() << " us to remove a line"
+    );
+    BOOST_CHECK_EQUAL(ok, expectedOk);
+    BOOST_CHECK(nw.IsFrozen());
+
+    CheckSameLayout(nw, expected, src);
+    BOOST_CHECK(nw.GetLineName(removedLine).empty());
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount(keptStation), 1);
+    for (const auto& stationJson : src.at("stations")) {
+        const auto station {stationJson.at("station_id").get<Id>()};
+        BOOST_CHECK_EQUAL(
+            nw.GetFastestTravelTime(keptStation, station),
+            expected.GetFastestTravelTime(keptStation, station)
+        );
+    }
+
+    // Removed stations are not saved in snapshots.
+    const auto destination {
+        std::filesystem::temp_directory_path() / "network-monitor-diff.bin"
+    };
+    ok = nw.SaveSnapshot(destination);
+    BOOST_REQUIRE(ok);
+    TransportNetwork loaded {};
+    ok = loaded.LoadSnapshot(destination);
+    BOOST_REQUIRE(ok);
+    CheckSameLayout(loaded, expected, src);
+    std::filesystem::remove(destination);
+}
+
+BOOST_AUTO_TEST_CASE(bad_layout)
+{
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    };
+    auto src = ParseJsonFile(testFilePath);
+
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+
+    // A stop at an unknown station fails before anything is changed.
+    src["travel_times"][0]["travel_time"] = 42;
+    src["stations"].erase(0);
+    BOOST_CHECK_THROW(nw.ApplyLayoutDiff(src), nlohmann::json::exception);
+
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 1);
+    auto routes {nw.GetRoutesServingStation("station_0")};
+    BOOST_REQUIRE_EQUAL(routes.size(), 1);
+    BOOST_CHECK_EQUAL(routes[0], "route_0");
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // ApplyLayoutDiff
+
+BOOST_AUTO_TEST_SUITE(Remove);
+
+BOOST_AUTO_TEST_CASE(remove_route)
+{
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_1line_2routes.json"
+    };
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(testFilePath))};
+    BOOST_REQUIRE(ok);
+
+    ok = nw.RemoveRoute("route_0");
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.IsFrozen());
+    BOOST_CHECK(!nw.RemoveRoute("route_0"));
+
+    BOOST_CHECK(nw.GetRoutesServingStation("station_0").empty());
+    auto routes {nw.GetRoutesServingStation("station_1")};
+    BOOST_REQUIRE_EQUAL(routes.size(), 1);
+    BOOST_CHECK_EQUAL(routes[0], "route_1");
+    BOOST_CHECK(nw.GetRouteDirection("route_0").empty());
+    BOOST_CHECK_EQUAL(nw.GetLineName("line_0"), "Line 0 Name");
+    BOOST_CHECK(!nw.SetTravelTime("station_0", "station_1", 1));
+    BOOST_CHECK(nw.SetTravelTime("station_1", "station_2", 2));
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_1", "station_1", "station_2"), 2
+    );
+
+    ok = nw.RemoveLine("line_0");
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!nw.RemoveLine("line_0"));
+    BOOST_CHECK(nw.GetLineName("line_0").empty());
+    BOOST_CHECK(nw.GetRoutesServingStation("station_1").empty());
+    BOOST_CHECK(!nw.SetTravelTime("station_1", "station_2", 2));
+}
+
+BOOST_AUTO_TEST_CASE(suspend_station)
+{
+    auto testFilePath {
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    };
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(testFilePath))};
+    BOOST_REQUIRE(ok);
+    ok = nw.RecordPassengerEvent({"station_1", PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+
+    // route_0: 0 ---> [1] ---> 2
+    ok = nw.SuspendStation("station_1");
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(!nw.SuspendStation("station_42"));
+    BOOST_CHECK(nw.GetRoutesServingStation("station_1").empty());
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_1"), 1);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_2"), 1 + 2);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 1 + 2
+    );
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_0", "station_1"), 0
+    );
+    const auto path {nw.GetFastestPath("station_0", "station_2")};
+    BOOST_REQUIRE_EQUAL(path.steps.size(), 1);
+    BOOST_CHECK_EQUAL(path.totalTravelTime, 1 + 2);
+
+    // The route changes with the new travel time of the skipping edge.
+    ok = nw.SetTravelTime("station_2", "station_0", 5);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 5
+    );
+
+    // A route left with a single stop is removed.
+    ok = nw.SuspendStation("station_0");
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.GetRoutesServingStation("station_2").empty());
+    BOOST_CHECK(nw.GetRouteDirection("route_0").empty());
+}
+
+BOOST_AUTO_TEST_CASE(full_layout)
+{
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+    const auto keptStation {
+        src.at("lines").back().at("routes")[0].at("route_stops")[0].get<Id>()
+    };
+    ok = nw.RecordPassengerEvent({keptStation, PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+
+    const auto removedLine {src.at("lines")[0].at("line_id").get<Id>()};
+    src["lines"].erase(0);
+    TransportNetwork expected {};
+    auto start {std::chrono::steady_clock::now()};
+    expected.FromJson(nlohmann::json(src));
+    auto jsonElapsed {std::chrono::steady_clock::now() - start};
+
+    start = std::chrono::steady_clock::now();
+    ok = nw.RemoveLine(removedLine);
+    auto removeElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK(nw.IsFrozen());
+    BOOST_TEST_MESSAGE(
+        "Line removal on the full layout: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            removeElapsed
+        ).count() << " us, against " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            jsonElapsed
+        ).count() << " us to rebuild from JSON"
+    );
+
+    auto check = [&src, &expected, &keptStation](const TransportNetwork& nw) {
+        for (const auto& stationJson : src.at("stations")) {
+            const auto station {stationJson.at("station_id").get<Id>()};
+            BOOST_CHECK(
+                nw.GetRoutesServingStation(station) ==
+                expected.GetRoutesServingStation(station)
+            );
+            BOOST_CHECK_EQUAL(
+                nw.GetFastestTravelTime(keptStation, station),
+                expected.GetFastestTravelTime(keptStation, station)
+            );
+        }
+        for (const auto& lineJson : src.at("lines")) {
+            const auto line {lineJson.at("line_id").get<Id>()};
+            for (const auto& routeJson : lineJson.at("routes")) {
+                const auto stops {
+                    routeJson.at("route_stops").get<std::vector<Id>>()
+                };
+                const auto route {routeJson.at("route_id").get<Id>()};
+                BOOST_CHECK_EQUAL(
+                    nw.GetTravelTime(line, route, stops.front(), stops.back()),
+                    expected.GetTravelTime(line, route, stops.front(), stops.back())
+                );
+            }
+        }
+        BOOST_CHECK_EQUAL(nw.GetPassengerCount(keptStation), 1);
+    };
+    check(nw);
+
+    // Compacting renumbers the stations, lines, and routes internally, which
+    // does not show from outside.
+    const TransportNetwork copy {nw};
+    const auto copyName {copy.GetStationName(keptStation)};
+    nw.Compact();
+    BOOST_CHECK(nw.IsFrozen());
+    check(nw);
+
+    // The strings move to new storage; the copy keeps the old one.
+    const auto name {nw.GetStationName(keptStation)};
+    BOOST_CHECK_EQUAL(name, copyName);
+    BOOST_CHECK(name.data() != copyName.data());
+    for (const auto& lineJson : src.at("lines")) {
+        BOOST_CHECK_EQUAL(
+            nw.GetLineName(lineJson.at("line_id").get<Id>()),
+            lineJson.at("name").get<Id>()
+        );
+    }
+    check(copy);
+    ok = nw.AddLine({removedLine, "Line Name", {}});
+    BOOST_CHECK(ok);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // Remove
+
+BOOST_AUTO_TEST_SUITE(Snapshot);
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    const auto destination {
+        std::filesystem::temp_directory_path() / "network-monitor-snapshot.bin"
+    };
+    auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT);
+
+    TransportNetwork expected {};
+    auto ok {expected.FromJson(nlohmann::json(src))};
+    BOOST_REQUIRE(ok);
+    ok = expected.SaveSnapshot(destination);
+    BOOST_REQUIRE(ok);
+
+    // Compare the snapshot load time against parsing the JSON layout.
+    auto start {std::chrono::steady_clock::now()};
+    {
+        TransportNetwork nw {};
+        ok = nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT));
+        BOOST_REQUIRE(ok);
+    }
+    auto jsonElapsed {std::chrono::steady_clock::now() - start};
+    start = std::chrono::steady_clock::now();
+    TransportNetwork nw {};
+    ok = nw.LoadSnapshot(destination);
+    auto snapshotElapsed {std::chrono::steady_clock::now() - start};
+    BOOST_REQUIRE(ok);
+    BOOST_TEST_MESSAGE(
+        "Network layout load: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            jsonElapsed
+        ).count() << " us from JSON, " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            snapshotElapsed
+        ).count() << " us from the snapshot"
+    );
+    BOOST_CHECK(nw.IsFrozen());
+
+    for (const auto& stationJson : src.at("stations")) {
+        const auto station {stationJson.at("station_id").get<Id>()};
+        BOOST_CHECK(
+            nw.GetRoutesServingStation(station) ==
+            expected.GetRoutesServingStation(station)
+        );
+        BOOST_CHECK_EQUAL(nw.GetPassengerCount(station), 0);
+    }
+    for (const auto& travelTimeJson : src.at("travel_times")) {
+        const auto stationA {travelTimeJson.at("start_station_id").get<Id>()};
+        const auto stationB {travelTimeJson.at("end_station_id").get<Id>()};
+        BOOST_CHECK_EQUAL(
+            nw.GetTravelTime(stationA, stationB),
+            expected.GetTravelTime(stationA, stationB)
+        );
+    }
+    for (const auto& lineJson : src.at("lines")) {
+        for (const auto& routeJson : lineJson.at("routes")) {
+            const auto stops {routeJson.at("route_stops").get<std::vector<Id>>()};
+            const auto line {lineJson.at("line_id").get<Id>()};
+            const auto route {routeJson.at("route_id").get<Id>()};
+            BOOST_CHECK_EQUAL(
+                nw.GetTravelTime(line, route, stops.front(), stops.back()),
+                expected.GetTravelTime(line, route, stops.front(), stops.back())
+            );
+        }
+    }
+    BOOST_CHECK_EQUAL(
+        nw.GetFastestTravelTime("station_000", "station_300"),
+        expected.GetFastestTravelTime("station_000", "station_300")
+    );
+
+    // The crowding cost is kept, like the passenger flow history settings.
+    TransportNetwork crowded {};
+    crowded.SetCrowdingCost({}, [](unsigned int travelTime, size_t) {
+        return travelTime * 2;
+    });
+    ok = crowded.LoadSnapshot(destination);
+    BOOST_REQUIRE(ok);
+    BOOST_CHECK_EQUAL(
+        crowded.GetCrowdedTravelTime("station_000", "station_001"),
+        2 * expected.GetTravelTime("station_000", "station_001")
+    );
+
+    // The loaded network can still be changed.
+    ok = nw.SetTravelTime("station_000", "station_001", 42);
+    BOOST_CHECK(ok);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_000", "station_001"), 42);
+    ok = nw.AddStation({"station_new", "New Station"});
+    BOOST_CHECK(ok);
+
+    std::filesystem::remove(destination);
+}
+
+BOOST_AUTO_TEST_CASE(bad_snapshots)
+{
+    const auto destination {
+        std::filesystem::temp_directory_path() / "network-monitor-snapshot.bin"
+    };
+    TransportNetwork original {};
+    auto ok {original.FromJson(ParseJsonFile(
+        std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+    ))};
+    BOOST_REQUIRE(ok);
+    ok = original.SaveSnapshot(destination);
+    BOOST_REQUIRE(ok);
+
+    std::string contents {};
+    {
+        std::ifstream file {destination, std::ios::binary};
+        std::ostringstream buffer {};
+        buffer << file.rdbuf();
+        contents = buffer.str();
+    }
+    BOOST_REQUIRE(contents.size() > 32);
+
+    auto writeFile {[&destination](const std::string& data) {
+        std::ofstream file {destination, std::ios::binary | std::ios::trunc};
+        file << data;
+    }};
+
+    // A missing file, an empty file, a truncated file, a corrupted payload, and
+    // a wrong version are all rejected. The network is left unchanged.
+    TransportNetwork nw {};
+    ok = nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT));
+    BOOST_REQUIRE(ok);
+
+    BOOST_CHECK(!nw.LoadSnapshot(
+        std::filesystem::temp_directory_path() / "network-monitor-missing.bin"
+    ));
+    std::string corrupted {contents};
+    corrupted[corrupted.size() / 2] ^= 0x01;
+    std::string wrongVersion {contents};
+    wrongVersion[12] ^= 0x01;
+    for (const auto& data : {
+        std::string {},
+        contents.substr(0, contents.size() - 1),
+        corrupted,
+        wrongVersion,
+    }) {
+        writeFile(data);
+        BOOST_CHECK(!nw.LoadSnapshot(destination));
+        BOOST_CHECK_EQUAL(nw.GetTravelTime("station_000", "station_001"), 2);
+    }
+
+    // The untouched file loads.
+    writeFile(contents);
+    BOOST_CHECK(nw.LoadSnapshot(destination));
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 1);
+
+    std::filesystem::remove(destination);
+}
+
+BOOST_AUTO_TEST_CASE(take_snapshot)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+    nw.BuildTravelTimeMatrix();
+    ok = nw.RecordPassengerEvent({"station_000", PassengerEvent::Type::In});
+    BOOST_REQUIRE(ok);
+
+    auto start {std::chrono::steady_clock::now()};
+    const TransportNetworkSnapshot snapshot {nw.TakeSnapshot()};
+    auto elapsed {std::chrono::steady_clock::now() - start};
+    BOOST_TEST_MESSAGE(
+        "TakeSnapshot on the full layout: " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            elapsed
+        ).count() << " us"
+    );
+    BOOST_REQUIRE(snapshot != nullptr);
+
+    // The snapshot shares the strings of the layout.
+    BOOST_CHECK(
+        snapshot->GetStationName("station_000").data() ==
+        nw.GetStationName("station_000").data()
+    );
+    const auto fastest {nw.GetFastestTravelTime("station_000", "station_300")};
+
+    // Changes to the network after the snapshot do not show in the snapshot.
+    ok = true;
+    ok &= nw.RecordPassengerEvent({"station_000", PassengerEvent::Type::In});
+    ok &= nw.SetTravelTime("station_000", "station_001", 42);
+    ok &= nw.AddStation({"station_new", "New Station"});
+    BOOST_REQUIRE(ok);
+
+    BOOST_CHECK_EQUAL(snapshot->GetPassengerCount("station_000"), 1);
+    BOOST_CHECK_EQUAL(snapshot->GetTravelTime("station_000", "station_001"), 2);
+    BOOST_CHECK(snapshot->HasTravelTimeMatrix());
+    BOOST_CHECK_EQUAL(
+        snapshot->GetFastestTravelTime("station_000", "station_300"),
+        fastest
+    );
+    BOOST_CHECK(snapshot->GetStationName("station_new").empty());
+
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_000"), 2);
+    BOOST_CHECK_EQUAL(nw.GetTravelTime("station_000", "station_001"), 42);
+    BOOST_CHECK_EQUAL(nw.GetStationName("station_new"), "New Station");
+    BOOST_CHECK_EQUAL(
+        snapshot->GetStationName("station_000"),
+        nw.GetStationName("station_000")
+    );
+}
+
+BOOST_AUTO_TEST_CASE(publisher_concurrent)
+{
+    TransportNetwork nw {};
+    auto ok {nw.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT))};
+    BOOST_REQUIRE(ok);
+
+    SnapshotPublisher publisher {};
+    BOOST_CHECK(publisher.GetLatest() == nullptr);
+    publisher.Publish(nw.TakeSnapshot());
+
+    // The writer keeps the travel time of an edge equal to the passenger
+    // count of a station, and readers check that every snapshot they get is
+    // consistent.
+    constexpr int nUpdates {500};
+    std::atomic<bool> done {false};
+    std::atomic<size_t> inconsistent {0};
+    auto reader = [&publisher, &done, &inconsistent]() {
+        while (!done) {
+            const TransportNetworkSnapshot snapshot {publisher.GetLatest()};
+            const auto count {snapshot->GetPassengerCount("station_000")};
+            const auto travelTime {
+                snapshot->GetTravelTime("station_000", "station_001")
+            };
+            if (count > 0 && count != travelTime) {
+                ++inconsistent;
+            }
+        }
+    };
+    std::vector<std::thread> readers {};
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back(reader);
+    }
+    for (int i = 1; i <= nUpdates; ++i) {
+        nw.RecordPassengerEvent({"station_000", PassengerEvent::Type::In});
+        nw.SetTravelTime("station_000", "station_001", i);
+        publisher.Publish(nw.TakeSnapshot());
+    }
+    done = true;
+    for (auto& thread : readers) {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(inconsistent, 0);
+    BOOST_CHECK_EQUAL(
+        publisher.GetLatest()->GetPassengerCount("station_000"),
+        nUpdates
+    );
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // Snapshot
+
 BOOST_AUTO_TEST_SUITE_END(); // class_TransportNetwork
 
 BOOST_AUTO_TEST_SUITE_END(); // websocket_client
\ No newline at end of file